@@ -22,6 +22,7 @@
 #include <stddef.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
 
 #ifdef HAVE_STDINT_H
 # include <stdint.h>
@@ -122,6 +123,12 @@ static void *luaL_testudata(lua_State *L, int ud, const char *tname) {
 #define ALIEN_LIBRARY_META "alien library"
 #define ALIEN_FUNCTION_META "alien function"
 #define ALIEN_BUFFER_META "alien buffer"
+#define ALIEN_ACCESSOR_META "alien accessor"
+#define ALIEN_VIEW_META "alien buffer view"
+#define ALIEN_ARRAY_META "alien array"
+#define ALIEN_LAYOUT_META "alien struct layout"
+#define ALIEN_STRUCT_META "alien struct"
+#define ALIEN_STATE_KEY "alien state"
 
 /* Information to compute structure access */
 
@@ -233,17 +240,104 @@ typedef struct {
   int nparams;
   alien_Type *params;
   ffi_type **ffi_params;
+  /* marshalling plan, compiled by alien_function_types */
+  struct alien_Plan *plan;
+  int busy; /* calls in progress (the plan's frame is in use) */
   /* callback part */
   lua_State *L;
+  struct alien_State *st;
   void *ffi_codeloc;
   int fn_ref;
 } alien_Function;
 
+/* a function call in progress, linked to the one it runs inside of */
+typedef struct alien_Call {
+  alien_Function *af;
+  struct alien_Call *prev;
+} alien_Call;
+
+/* shared by all threads of a Lua state */
+typedef struct alien_State {
+  alien_Call *calls; /* innermost call in progress */
+} alien_State;
+
 typedef struct {
   char *p;
   size_t size;
 } alien_Buffer;
 
+typedef struct {
+  alien_Buffer *ab; /* storage; the buffer is kept in the uservalue */
+  alien_Type type;
+  size_t size; /* size of each element */
+  size_t first; /* 0-based index of element 1 in the buffer */
+  size_t length;
+  int slice; /* a view into another array's buffer */
+} alien_Array;
+
+typedef struct {
+  size_t offset;
+  alien_Type type;
+} alien_Field;
+
+/* a struct type, laid out once by alien.defstruct */
+typedef struct {
+  size_t size; /* including tail padding, as sizeof would */
+  size_t align;
+  int nfields;
+  alien_Field fields[1];
+} alien_Layout;
+
+/* a struct instance over a buffer; the uservalue holds the buffer,
+   the layout's field table and the layout */
+typedef struct {
+  alien_Buffer *ab;
+  const alien_Layout *layout;
+} alien_Struct;
+
+#define alien_arraydata(arr) ((arr)->ab->p + (arr)->first * (arr)->size)
+
+/* Direct calls: on these ABIs integer and pointer arguments each take
+   one machine word in the same registers, so functions whose parameters
+   all fit in a word can be called through a plain C prototype instead
+   of ffi_call. */
+#if (defined(__x86_64__) || defined(_M_X64) || defined(_M_AMD64) || \
+     (defined(__aarch64__) && !defined(__AARCH64EB__)) || defined(_M_ARM64))
+#define ALIEN_DIRECT_CALLS
+#endif
+
+typedef ptrdiff_t alien_Word;
+
+/* one argument frame slot (or return value); every type fits in one */
+typedef union {
+  double d;
+  float f;
+  long long ll;
+  alien_Word w;
+  int i;
+  long l;
+  unsigned long ul;
+  void *p;
+} alien_Slot;
+
+/* converts Lua value at index j into the argument slot arg */
+typedef void (*alien_Conv)(lua_State *L, int j, void *arg);
+
+/* calls fn with the arguments in slots a, storing the result in r */
+typedef void (*alien_Direct)(void *fn, alien_Slot *a, alien_Slot *r);
+
+/* A marshalling plan: a converter per parameter plus a packed argument
+   frame. Slot i holds parameter i; "ref" parameters also get a slot
+   after the parameters for the value they point to. */
+typedef struct alien_Plan {
+  int nslots;
+  int nrefs;
+  alien_Direct direct; /* trampoline for the signature, or NULL for libffi */
+  alien_Conv *convs;
+  void **args; /* pointers to the parameter slots of frame */
+  alien_Slot frame[1];
+} alien_Plan;
+
 typedef struct {
   alien_Type tag;
   union {
@@ -376,7 +470,10 @@ static alien_Buffer *alien_checkbuffer(lua_State *L, int index) {
 static void *alien_touserdata(lua_State *L, int index) {
   void *ud = lua_touserdata(L, index);
   if(!ud) return NULL;
-  return luaL_testudata(L, index, ALIEN_BUFFER_META) ? ((alien_Buffer *)ud)->p : ud;
+  if(luaL_testudata(L, index, ALIEN_BUFFER_META)) return ((alien_Buffer *)ud)->p;
+  if(luaL_testudata(L, index, ALIEN_ARRAY_META)) return alien_arraydata((alien_Array *)ud);
+  if(luaL_testudata(L, index, ALIEN_STRUCT_META)) return ((alien_Struct *)ud)->ab->p;
+  return ud;
 }
 
 static void *alien_checknonnull(lua_State *L, int index) {
@@ -430,6 +527,8 @@ static int alien_makefunction(lua_State *L, void *lib, void *fn, char *name) {
   af->ret_type = AT_void;
   af->params = NULL;
   af->ffi_params = NULL;
+  af->plan = NULL;
+  af->busy = 0;
   return 1;
 }
 
@@ -479,9 +578,18 @@ static int alien_library_tostring(lua_State *L) {
   return 1;
 }
 
-static void alien_callback_call(ffi_cif *cif, void *resp, void **args, void *data) {
-  alien_Function *ac = (alien_Function *)data;
-  lua_State *L = ac->L;
+typedef struct {
+  alien_Function *ac;
+  void *resp;
+  void **args;
+} alien_Callback;
+
+/* runs a callback; called in protected mode by alien_callback_call */
+static int alien_callback_run(lua_State *L) {
+  alien_Callback *cb = (alien_Callback *)lua_touserdata(L, 1);
+  alien_Function *ac = cb->ac;
+  void *resp = cb->resp;
+  void **args = cb->args;
   int i;
   lua_rawgeti(L, LUA_REGISTRYINDEX, ac->fn_ref);
   for(i = 0; i < ac->nparams; i++) {
@@ -546,6 +654,25 @@ static void alien_callback_call(ffi_cif *cif, void *resp, void **args, void *dat
   default: luaL_error(L, "alien: unknown return type in callback");
   }
   lua_pop(ac->L, 1);
+  return 0;
+}
+
+static void alien_callback_call(ffi_cif *cif, void *resp, void **args, void *data) {
+  alien_Function *ac = (alien_Function *)data;
+  lua_State *L = ac->L;
+  alien_Callback cb;
+  cb.ac = ac; cb.resp = resp; cb.args = args;
+  lua_pushcfunction(L, alien_callback_run);
+  lua_pushlightuserdata(L, &cb);
+  if(lua_pcall(L, 1, 0, 0) != 0) {
+    /* the error unwinds the call that ran the callback: release it */
+    alien_Call *call = ac->st->calls;
+    if(call) {
+      call->af->busy--;
+      ac->st->calls = call->prev;
+    }
+    lua_error(L);
+  }
 }
 
 static int alien_callback_new(lua_State *L) {
@@ -562,6 +689,11 @@ static int alien_callback_new(lua_State *L) {
   ac->nparams = 0;
   ac->params = NULL;
   ac->ffi_params = NULL;
+  ac->plan = NULL;
+  ac->busy = 0;
+  lua_getfield(L, LUA_REGISTRYINDEX, ALIEN_STATE_KEY);
+  ac->st = (alien_State *)lua_touserdata(L, -1);
+  lua_pop(L, 1);
   lua_pushvalue(L, 1);
   ac->fn_ref = luaL_ref(L, LUA_REGISTRYINDEX);
   luaL_getmetatable(L, ALIEN_FUNCTION_META);
@@ -579,34 +711,237 @@ static int alien_callback_new(lua_State *L) {
   return 1;
 }
 
-static int alien_sizeof(lua_State *L) {
-  static const size_t sizes[] = {
+static const size_t alien_sizes[] = {
 #define MENTRY(_n, _b, _s, _a)  sizeof(_s),
-    type_map
+  type_map
 #undef MENTRY
-    0
-  };
-  lua_pushinteger(L, sizes[luaL_checkoption(L, 1, "int", alien_typenames)]);
+  0
+};
+
+static int alien_sizeof(lua_State *L) {
+  lua_pushinteger(L, alien_sizes[luaL_checkoption(L, 1, "int", alien_typenames)]);
   return 1;
 }
 
-static int alien_align(lua_State *L) {
-  static const size_t aligns[] = {
-    0
+static const size_t alien_aligns[] = {
+  0
 #define MENTRY(_n, _b, _s, _a) ALIEN_SPLICE(_a, _ALIGN),
-    type_map
+  type_map
 #undef MENTRY
-    0
-  };
-  lua_pushinteger(L, aligns[luaL_checkoption(L, 1, "char", alien_typenames)]);
+  0
+};
+
+static int alien_align(lua_State *L) {
+  lua_pushinteger(L, alien_aligns[luaL_checkoption(L, 1, "char", alien_typenames)]);
   return 1;
 }
 
+/* Parameter converters, indexed by alien_Type */
+
+#define ALIEN_CONV_FLT(_b, _t) \
+  static void ALIEN_SPLICE(alien_conv_, _b)(lua_State *L, int j, void *arg) { \
+    *((_t*)arg) = (_t)lua_tonumber(L, j); \
+  }
+
+#ifdef ALIEN_DIRECT_CALLS
+/* integers are widened to a whole slot, as direct calls pass the slot;
+   these targets are little endian, so libffi still finds the value at
+   the start of the slot */
+#define ALIEN_CONV(_b, _t, _get) \
+  static void ALIEN_SPLICE(alien_conv_, _b)(lua_State *L, int j, void *arg) { \
+    *((alien_Word*)arg) = (alien_Word)(_t)_get(L, j); \
+  }
+#else
+#define ALIEN_CONV(_b, _t, _get) \
+  static void ALIEN_SPLICE(alien_conv_, _b)(lua_State *L, int j, void *arg) { \
+    *((_t*)arg) = (_t)_get(L, j); \
+  }
+#endif
+
+#define ALIEN_CONV_REF(_b, _t) \
+  static void ALIEN_SPLICE(alien_conv_, _b)(lua_State *L, int j, void *arg) { \
+    **((_t**)arg) = (_t)lua_tonumber(L, j); \
+  }
+
+ALIEN_CONV(byte, signed char, lua_tointeger)
+ALIEN_CONV(char, unsigned char, lua_tointeger)
+ALIEN_CONV(short, short, lua_tonumber)
+ALIEN_CONV(ushort, unsigned short, lua_tonumber)
+ALIEN_CONV(int, int, lua_tonumber)
+ALIEN_CONV(uint, unsigned int, lua_tonumber)
+ALIEN_CONV(long, long, lua_tonumber)
+ALIEN_CONV(ulong, unsigned long, lua_tonumber)
+ALIEN_CONV(ptrdiff_t, ptrdiff_t, lua_tonumber)
+ALIEN_CONV(size_t, size_t, lua_tonumber)
+ALIEN_CONV_FLT(float, float)
+ALIEN_CONV_FLT(double, double)
+ALIEN_CONV(longlong, long long, lua_tonumber)
+ALIEN_CONV(ulonglong, unsigned long long, lua_tonumber)
+ALIEN_CONV_REF(refchar, char)
+ALIEN_CONV_REF(refint, int)
+ALIEN_CONV_REF(refuint, unsigned int)
+ALIEN_CONV_REF(refdouble, double)
+
+static void alien_conv_string(lua_State *L, int j, void *arg) {
+  if(lua_isuserdata(L, j))
+    *((char**)arg) = alien_touserdata(L, j);
+  else
+    *((const char**)arg) = lua_isnil(L, j) ? NULL : lua_tostring(L, j);
+}
+
+static void alien_conv_pointer(lua_State *L, int j, void *arg) {
+  *((void**)arg) = lua_isstring(L, j) ? (void*)lua_tostring(L, j) : alien_touserdata(L, j);
+}
+
+static void alien_conv_callback(lua_State *L, int j, void *arg) {
+  *((void**)arg) = alien_checkfunction(L, j)->fn;
+}
+
+#define alien_conv_void NULL  /* not a valid parameter type */
+
+static const alien_Conv alien_convs[] = {
+#define MENTRY(_n, _b, _s, _a) ALIEN_SPLICE(alien_conv_, _b),
+  type_map
+#undef MENTRY
+  NULL
+};
+
+#define alien_isref(t) ((t) >= AT_refchar && (t) <= AT_refdouble)
+
+#ifdef ALIEN_DIRECT_CALLS
+
+#define ALIEN_DIRECT_W(_n, _proto, _args) \
+  static void alien_direct_w##_n(void *fn, alien_Slot *a, alien_Slot *r) { \
+    (void)a; r->w = ((alien_Word (*)_proto)fn)_args; \
+  }
+
+ALIEN_DIRECT_W(0, (void), ())
+ALIEN_DIRECT_W(1, (alien_Word), (a[0].w))
+ALIEN_DIRECT_W(2, (alien_Word, alien_Word), (a[0].w, a[1].w))
+ALIEN_DIRECT_W(3, (alien_Word, alien_Word, alien_Word), (a[0].w, a[1].w, a[2].w))
+ALIEN_DIRECT_W(4, (alien_Word, alien_Word, alien_Word, alien_Word),
+               (a[0].w, a[1].w, a[2].w, a[3].w))
+ALIEN_DIRECT_W(5, (alien_Word, alien_Word, alien_Word, alien_Word, alien_Word),
+               (a[0].w, a[1].w, a[2].w, a[3].w, a[4].w))
+ALIEN_DIRECT_W(6, (alien_Word, alien_Word, alien_Word, alien_Word, alien_Word, alien_Word),
+               (a[0].w, a[1].w, a[2].w, a[3].w, a[4].w, a[5].w))
+
+static const alien_Direct alien_direct_w[] = {
+  alien_direct_w0, alien_direct_w1, alien_direct_w2, alien_direct_w3,
+  alien_direct_w4, alien_direct_w5, alien_direct_w6
+};
+
+static void alien_direct_d0(void *fn, alien_Slot *a, alien_Slot *r) {
+  (void)a; r->d = ((double (*)(void))fn)();
+}
+
+static void alien_direct_d1(void *fn, alien_Slot *a, alien_Slot *r) {
+  r->d = ((double (*)(double))fn)(a[0].d);
+}
+
+static void alien_direct_d2(void *fn, alien_Slot *a, alien_Slot *r) {
+  r->d = ((double (*)(double, double))fn)(a[0].d, a[1].d);
+}
+
+static void alien_direct_d3(void *fn, alien_Slot *a, alien_Slot *r) {
+  r->d = ((double (*)(double, double, double))fn)(a[0].d, a[1].d, a[2].d);
+}
+
+static const alien_Direct alien_direct_d[] = {
+  alien_direct_d0, alien_direct_d1, alien_direct_d2, alien_direct_d3
+};
+
+/* types passed or returned in one integer register */
+static int alien_isword(alien_Type t) {
+  switch(t) {
+  case AT_byte: case AT_char: case AT_short: case AT_ushort: case AT_int:
+  case AT_uint: case AT_long: case AT_ulong: case AT_ptrdiff_t: case AT_size_t:
+  case AT_string: case AT_pointer: case AT_refchar: case AT_refint:
+  case AT_refuint: case AT_refdouble: case AT_callback:
+    return 1;
+  case AT_longlong: case AT_ulonglong:
+    return sizeof(long long) == sizeof(alien_Word);
+  default:
+    return 0;
+  }
+}
+
+/* trampoline for the signature of af, or NULL if libffi must be used */
+static alien_Direct alien_finddirect(alien_Function *af, ffi_abi abi) {
+  int i, words = 1, doubles = 1;
+  if(abi != FFI_DEFAULT_ABI || af->fn_ref)
+    return NULL;
+  for(i = 0; i < af->nparams; i++) {
+    words = words && alien_isword(af->params[i]);
+    doubles = doubles && af->params[i] == AT_double;
+  }
+  if(words && af->nparams <= 6 &&
+     (af->ret_type == AT_void || (af->ret_type <= AT_pointer &&
+                                  alien_isword(af->ret_type))))
+    return alien_direct_w[af->nparams];
+  if(doubles && af->nparams <= 3 && af->ret_type == AT_double)
+    return alien_direct_d[af->nparams];
+  return NULL;
+}
+
+#else
+
+#define alien_finddirect(af, abi) NULL
+
+#endif
+
+static size_t alien_plansize(int nparams, int nslots) {
+  return sizeof(alien_Plan) + sizeof(alien_Slot) * (nslots - 1) +
+    (sizeof(alien_Conv) + sizeof(void *)) * nparams;
+}
+
+/* points the args of a frame at its slots, and each "ref" slot at the
+   slot for its value */
+static void alien_layframe(alien_Function *af, alien_Slot *frame, void **args) {
+  int i, r = af->nparams;
+  for(i = 0; i < af->nparams; i++) {
+    args[i] = &frame[i];
+    if(alien_isref(af->params[i]))
+      frame[i].p = &frame[r++];
+  }
+}
+
+static void alien_freeplan(lua_State *L, alien_Function *af) {
+  void *aud;
+  lua_Alloc lalloc = lua_getallocf(L, &aud);
+  if(af->plan) {
+    lalloc(aud, af->plan, alien_plansize(af->nparams, af->plan->nslots), 0);
+    af->plan = NULL;
+  }
+}
+
+static void alien_makeplan(lua_State *L, alien_Function *af, ffi_abi abi, int direct) {
+  void *aud;
+  lua_Alloc lalloc = lua_getallocf(L, &aud);
+  alien_Plan *plan;
+  int i, nrefs = 0, nslots;
+  for(i = 0; i < af->nparams; i++)
+    if(alien_isref(af->params[i])) nrefs++;
+  nslots = af->nparams + nrefs;
+  if(nslots == 0) nslots = 1;
+  plan = (alien_Plan *)lalloc(aud, NULL, 0, alien_plansize(af->nparams, nslots));
+  if(!plan) luaL_error(L, "alien: out of memory");
+  plan->nslots = nslots;
+  plan->nrefs = nrefs;
+  plan->direct = direct ? alien_finddirect(af, abi) : NULL;
+  plan->args = (void **)(plan->frame + nslots);
+  plan->convs = (alien_Conv *)(plan->args + af->nparams);
+  for(i = 0; i < af->nparams; i++)
+    plan->convs[i] = alien_convs[af->params[i]];
+  alien_layframe(af, plan->frame, plan->args);
+  af->plan = plan;
+}
+
 static int alien_function_types(lua_State *L) {
   ffi_status status;
   ffi_abi abi;
   alien_Function *af = alien_checkfunction(L, 1);
-  int i, ret_type;
+  int i, ret_type, direct = 1;
   void *aud;
   lua_Alloc lalloc = lua_getallocf(L, &aud);
   if(lua_istable(L, 2)) {
@@ -616,13 +951,16 @@ static int alien_function_types(lua_State *L) {
     af->ffi_ret_type = ffitypes[ret_type];
     lua_getfield(L, 2, "abi");
     abi = ffi_abis[luaL_checkoption(L, -1, "default", ffi_abi_names)];
-    lua_pop(L, 2);
+    lua_getfield(L, 2, "direct");
+    direct = lua_isnil(L, -1) || lua_toboolean(L, -1);
+    lua_pop(L, 3);
   } else {
     ret_type = luaL_checkoption(L, 2, "int", alien_typenames);
     af->ret_type = ret_type;
     af->ffi_ret_type = ffitypes[ret_type];
     abi = FFI_DEFAULT_ABI;
   }
+  alien_freeplan(L, af);
   if(af->params) {
     lalloc(aud, af->params, sizeof(alien_Type) * af->nparams, 0);
     lalloc(aud, af->ffi_params, sizeof(ffi_type *) * af->nparams, 0);
@@ -654,6 +992,7 @@ static int alien_function_types(lua_State *L) {
       af->params[i] = type;
     }
   }
+  alien_makeplan(L, af, abi, direct);
   status = ffi_prep_cif(&(af->cif), abi, af->nparams,
                         af->ffi_ret_type,
                         af->ffi_params);
@@ -673,140 +1012,87 @@ static int alien_function_tostring(lua_State *L) {
   return 1;
 }
 
+/* calls the C function, keeping the plan's frame marked busy meanwhile;
+   if a callback raises an error, alien_callback_call releases it */
+static void alien_rawcall(alien_State *st, alien_Function *af,
+                          alien_Slot *frame, void **args, alien_Slot *ret) {
+  alien_Plan *plan = af->plan;
+  alien_Call call;
+  call.af = af;
+  call.prev = st->calls;
+  st->calls = &call;
+  af->busy++;
+  if(plan && plan->direct)
+    plan->direct(af->fn, frame, ret);
+  else
+    ffi_call(&(af->cif), af->fn, ret, args);
+  af->busy--;
+  st->calls = call.prev;
+}
+
 static int alien_function_call(lua_State *L) {
-  int iret; double dret; void *pret; long lret; unsigned long ulret; float fret;
-  int i, nrefi = 0, nrefui = 0, nrefd = 0, nrefc = 0;
+  alien_Slot ret;
+  int i;
   void **args = NULL;
+  alien_Slot *frame = NULL;
+  alien_State *st = (alien_State *)lua_touserdata(L, lua_upvalueindex(1));
   alien_Function *af = alien_checkfunction(L, 1);
-  ffi_cif *cif = &(af->cif);
+  alien_Plan *plan = af->plan;
   int nargs = lua_gettop(L) - 1;
   if(nargs != af->nparams)
     return luaL_error(L, "alien: too %s arguments (function %s)", nargs < af->nparams ? "few" : "many",
                       af->name ? af->name : "anonymous");
-  if(nargs > 0) args = alloca(sizeof(void*) * nargs);
-  for(i = 0; i < nargs; i++) {
-    void *arg;
-    int j = i + 2;
-    switch(af->params[i]) {
-    case AT_byte:
-      arg = alloca(sizeof(char)); *((char*)arg) = (signed char)lua_tointeger(L, j);
-      break;
-    case AT_char:
-      arg = alloca(sizeof(unsigned char)); *((unsigned char*)arg) = (unsigned char)lua_tointeger(L, j);
-      break;
-    case AT_short:
-      arg = alloca(sizeof(short)); *((short*)arg) = (short)lua_tonumber(L, j);
-      break;
-    case AT_ushort:
-      arg = alloca(sizeof(unsigned short)); *((unsigned short*)arg) = (unsigned short)lua_tonumber(L, j);
-      break;
-    case AT_int:
-      arg = alloca(sizeof(int)); *((int*)arg) = (int)lua_tonumber(L, j);
-      break;
-    case AT_uint:
-      arg = alloca(sizeof(unsigned int)); *((unsigned int*)arg) = (unsigned int)lua_tonumber(L, j);
-      break;
-    case AT_long:
-      arg = alloca(sizeof(long)); *((long*)arg) = (long)lua_tonumber(L, j);
-      break;
-    case AT_ulong:
-      arg = alloca(sizeof(unsigned long)); *((unsigned long*)arg) = (unsigned long)lua_tonumber(L, j);
-      break;
-    case AT_ptrdiff_t:
-      arg = alloca(sizeof(ptrdiff_t)); *((ptrdiff_t*)arg) = (ptrdiff_t)lua_tonumber(L, j);
-      break;
-    case AT_size_t:
-      arg = alloca(sizeof(size_t)); *((size_t*)arg) = (size_t)lua_tonumber(L, j);
-      break;
-    case AT_float:
-      arg = alloca(sizeof(float)); *((float*)arg) = (float)lua_tonumber(L, j);
-      break;
-    case AT_double:
-      arg = alloca(sizeof(double)); *((double*)arg) = (double)lua_tonumber(L, j);
-      break;
-    case AT_string:
-      arg = alloca(sizeof(char*));
-      if(lua_isuserdata(L, j))
-        *((char**)arg) = alien_touserdata(L, j);
-      else
-        *((const char**)arg) = lua_isnil(L, j) ? NULL : lua_tostring(L, j);
-      break;
-    case AT_pointer:
-      arg = alloca(sizeof(char*));
-      *((void**)arg) = lua_isstring(L, j) ? (void*)lua_tostring(L, j) : alien_touserdata(L, j);
-      break;
-    case AT_refchar:
-      arg = alloca(sizeof(char *));
-      *((char **)arg) = alloca(sizeof(char));
-      **((char **)arg) = (char)lua_tonumber(L, j);
-      nrefc++;
-      break;
-    case AT_refint:
-      arg = alloca(sizeof(int *));
-      *((int **)arg) = alloca(sizeof(int));
-      **((int **)arg) = (int)lua_tonumber(L, j);
-      nrefi++;
-      break;
-    case AT_refuint:
-      arg = alloca(sizeof(unsigned int *));
-      *((unsigned int **)arg) = alloca(sizeof(unsigned int));
-      **((unsigned int **)arg) = (unsigned int)lua_tonumber(L, j);
-      nrefui++;
-      break;
-    case AT_refdouble:
-      arg = alloca(sizeof(double *));
-      *((double **)arg) = alloca(sizeof(double));
-      **((double **)arg) = (double)lua_tonumber(L, j);
-      nrefd++;
-      break;
-    case AT_longlong:
-      arg = alloca(sizeof(long long)); *((long long*)arg) = (long long)lua_tonumber(L, j);
-      break;
-    case AT_ulonglong:
-      arg = alloca(sizeof(unsigned long long)); *((unsigned long long*)arg) = (unsigned long long)lua_tonumber(L, j);
-      break;
-    case AT_callback:
-      arg = alloca(sizeof(void*)); *((void**)arg) = (alien_Function *)alien_checkfunction(L, j)->fn;
-      break;
-    default:
-      return luaL_error(L, "alien: parameter %d is of unknown type (function %s)", j,
-                        af->name ? af->name : "anonymous");
+  if(af->ret_type > AT_pointer)
+    return luaL_error(L, "alien: unknown return type (function %s)", af->name ?
+                      af->name : "anonymous");
+  if(nargs > 0) {
+    if(af->busy) {
+      /* called again from a callback while the plan's frame is in use */
+      frame = alloca(sizeof(alien_Slot) * plan->nslots);
+      args = alloca(sizeof(void*) * nargs);
+      alien_layframe(af, frame, args);
+    } else {
+      frame = plan->frame;
+      args = plan->args;
+    }
+    for(i = 0; i < nargs; i++) {
+      if(!plan->convs[i])
+        return luaL_error(L, "alien: parameter %d is of unknown type (function %s)", i + 2,
+                          af->name ? af->name : "anonymous");
+      plan->convs[i](L, i + 2, args[i]);
     }
-    args[i] = arg;
   }
-  pret = NULL;
+  alien_rawcall(st, af, frame, args, &ret);
   switch(af->ret_type) {
-  case AT_void: ffi_call(cif, af->fn, NULL, args); lua_pushnil(L); break;
-  case AT_byte: ffi_call(cif, af->fn, &iret, args); lua_pushnumber(L, (signed char)iret); break;
-  case AT_char: ffi_call(cif, af->fn, &iret, args); lua_pushnumber(L, (unsigned char)iret); break;
-  case AT_short: ffi_call(cif, af->fn, &iret, args); lua_pushnumber(L, (short)iret); break;
-  case AT_ushort: ffi_call(cif, af->fn, &iret, args); lua_pushnumber(L, (unsigned short)iret); break;
-  case AT_int: ffi_call(cif, af->fn, &iret, args); lua_pushnumber(L, iret); break;
-  case AT_uint: ffi_call(cif, af->fn, &iret, args); lua_pushnumber(L, (unsigned int)iret); break;
-  case AT_long: ffi_call(cif, af->fn, &lret, args); lua_pushnumber(L, lret); break;
-  case AT_ulong: ffi_call(cif, af->fn, &ulret, args); lua_pushnumber(L, (unsigned long)ulret); break;
-  case AT_ptrdiff_t: ffi_call(cif, af->fn, &lret, args); lua_pushnumber(L, lret); break;
-  case AT_size_t: ffi_call(cif, af->fn, &ulret, args); lua_pushnumber(L, (size_t)ulret); break;
-  case AT_float: ffi_call(cif, af->fn, &fret, args); lua_pushnumber(L, fret); break;
-  case AT_double: ffi_call(cif, af->fn, &dret, args); lua_pushnumber(L, dret); break;
-  case AT_string: ffi_call(cif, af->fn, &pret, args);
-    (pret ? lua_pushstring(L, (const char *)pret) : lua_pushnil(L)); break;
-  case AT_pointer: ffi_call(cif, af->fn, &pret, args);
-    (pret ? lua_pushlightuserdata(L, pret) : lua_pushnil(L)); break;
-  default:
-    return luaL_error(L, "alien: unknown return type (function %s)", af->name ?
-                      af->name : "anonymous");
+  case AT_void: lua_pushnil(L); break;
+  case AT_byte: lua_pushnumber(L, (signed char)ret.i); break;
+  case AT_char: lua_pushnumber(L, (unsigned char)ret.i); break;
+  case AT_short: lua_pushnumber(L, (short)ret.i); break;
+  case AT_ushort: lua_pushnumber(L, (unsigned short)ret.i); break;
+  case AT_int: lua_pushnumber(L, ret.i); break;
+  case AT_uint: lua_pushnumber(L, (unsigned int)ret.i); break;
+  case AT_long: lua_pushnumber(L, ret.l); break;
+  case AT_ulong: lua_pushnumber(L, ret.ul); break;
+  case AT_ptrdiff_t: lua_pushnumber(L, (ptrdiff_t)ret.w); break;
+  case AT_size_t: lua_pushnumber(L, (size_t)ret.w); break;
+  case AT_float: lua_pushnumber(L, ret.f); break;
+  case AT_double: lua_pushnumber(L, ret.d); break;
+  case AT_string: (ret.p ? lua_pushstring(L, (const char *)ret.p) : lua_pushnil(L)); break;
+  case AT_pointer: (ret.p ? lua_pushlightuserdata(L, ret.p) : lua_pushnil(L)); break;
+  default: break; /* checked above */
   }
-  for(i = 0; i < nargs; i++) {
-    switch(af->params[i]) {
-    case AT_refchar: lua_pushnumber(L, **(char **)args[i]); break;
-    case AT_refint: lua_pushnumber(L, **(int **)args[i]); break;
-    case AT_refuint: lua_pushnumber(L, **(unsigned int **)args[i]); break;
-    case AT_refdouble: lua_pushnumber(L, **(double **)args[i]); break;
-    default: break;
+  if(nargs > 0 && plan->nrefs > 0) {
+    for(i = 0; i < nargs; i++) {
+      switch(af->params[i]) {
+      case AT_refchar: lua_pushnumber(L, **(char **)args[i]); break;
+      case AT_refint: lua_pushnumber(L, **(int **)args[i]); break;
+      case AT_refuint: lua_pushnumber(L, **(unsigned int **)args[i]); break;
+      case AT_refdouble: lua_pushnumber(L, **(double **)args[i]); break;
+      default: break;
+      }
     }
   }
-  return 1 + nrefi + nrefui + nrefc + nrefd;
+  return 1 + (plan ? plan->nrefs : 0);
 }
 
 static int alien_library_gc(lua_State *L) {
@@ -826,6 +1112,7 @@ static int alien_function_gc(lua_State *L) {
   void *aud;
   lua_Alloc lalloc = lua_getallocf(L, &aud);
   if(af->name) LALLOC_FREE_STRING(lalloc, aud, af->name);
+  alien_freeplan(L, af);
   if(af->params) lalloc(aud, af->params, sizeof(alien_Type) * af->nparams, 0);
   if(af->ffi_params) lalloc(aud, af->ffi_params, sizeof(ffi_type *) * af->nparams, 0);
   if(af->fn_ref) {
@@ -986,38 +1273,46 @@ static int alien_buffer_tooffset(lua_State *L) {
   return 1;
 }
 
-static int alien_buffer_set(lua_State *L) {
-  char *b = alien_checkbuffer(L, 1)->p;
-  ptrdiff_t offset = luaL_checkinteger(L, 2) - 1;
-  int type = luaL_checkoption(L, 4, "char", alien_typenames);
+/* stores the value at index i into b as type; returns 0 for types
+   that cannot be stored */
+static int alien_setvalue(lua_State *L, char *b, int type, int i) {
   switch(type) {
-  case AT_byte: b[offset] = (signed char)lua_tointeger(L, 3); break;
-  case AT_char: b[offset] = (unsigned char)lua_tointeger(L, 3); break;
-  case AT_short: *((short*)(&b[offset])) = (short)lua_tonumber(L, 3); break;
-  case AT_ushort: *((unsigned short*)(&b[offset])) = (unsigned short)lua_tonumber(L, 3); break;
-  case AT_int: *((int*)(&b[offset])) = (int)lua_tonumber(L, 3); break;
-  case AT_uint: *((unsigned int*)(&b[offset])) = (unsigned int)lua_tonumber(L, 3); break;
-  case AT_long: *((long*)(&b[offset])) = (long)lua_tonumber(L, 3); break;
-  case AT_ulong: *((unsigned long*)(&b[offset])) = (unsigned long)lua_tonumber(L, 3); break;
-  case AT_ptrdiff_t: *((ptrdiff_t*)(&b[offset])) = (ptrdiff_t)lua_tonumber(L, 3); break;
-  case AT_size_t: *((size_t*)(&b[offset])) = (size_t)lua_tonumber(L, 3); break;
-  case AT_float: *((float*)(&b[offset])) = (float)lua_tonumber(L, 3); break;
-  case AT_double: *((double*)(&b[offset])) = (double)lua_tonumber(L, 3); break;
+  case AT_byte: *b = (signed char)lua_tointeger(L, i); break;
+  case AT_char: *b = (unsigned char)lua_tointeger(L, i); break;
+  case AT_short: *((short*)b) = (short)lua_tonumber(L, i); break;
+  case AT_ushort: *((unsigned short*)b) = (unsigned short)lua_tonumber(L, i); break;
+  case AT_int: *((int*)b) = (int)lua_tonumber(L, i); break;
+  case AT_uint: *((unsigned int*)b) = (unsigned int)lua_tonumber(L, i); break;
+  case AT_long: *((long*)b) = (long)lua_tonumber(L, i); break;
+  case AT_ulong: *((unsigned long*)b) = (unsigned long)lua_tonumber(L, i); break;
+  case AT_ptrdiff_t: *((ptrdiff_t*)b) = (ptrdiff_t)lua_tonumber(L, i); break;
+  case AT_size_t: *((size_t*)b) = (size_t)lua_tonumber(L, i); break;
+  case AT_float: *((float*)b) = (float)lua_tonumber(L, i); break;
+  case AT_double: *((double*)b) = (double)lua_tonumber(L, i); break;
   case AT_pointer:
-    if(lua_isnil(L, 3) || lua_isuserdata(L, 3)) {
-      *((void**)(&b[offset])) = alien_touserdata(L, 3);
+    if(lua_isnil(L, i) || lua_isuserdata(L, i)) {
+      *((void**)b) = alien_touserdata(L, i);
       break;
     }
     /* FALLTHROUGH, hence pointer before string */
   case AT_string: {
     size_t size;
-    const char *s = lua_tolstring(L, 3, &size);
-    memcpy(*((char**)(&b[offset])), s, size + 1);
+    const char *s = lua_tolstring(L, i, &size);
+    memcpy(*((char**)b), s, size + 1);
     break;
   }
-  case AT_callback: *((void**)(&b[offset])) = (alien_Function *)alien_checkfunction(L, 3)->fn; break;
-  default: return luaL_error(L, "alien: unknown type in buffer:put");
+  case AT_callback: *((void**)b) = (alien_Function *)alien_checkfunction(L, i)->fn; break;
+  default: return 0;
   }
+  return 1;
+}
+
+static int alien_buffer_set(lua_State *L) {
+  char *b = alien_checkbuffer(L, 1)->p;
+  ptrdiff_t offset = luaL_checkinteger(L, 2) - 1;
+  int type = luaL_checkoption(L, 4, "char", alien_typenames);
+  if(!alien_setvalue(L, &b[offset], type, 3))
+    return luaL_error(L, "alien: unknown type in buffer:put");
   return 0;
 }
 
@@ -1035,6 +1330,391 @@ static int alien_buffer_realloc(lua_State *L) {
   return 1;
 }
 
+/* pushes the value of type stored at b; returns 0 for types that
+   cannot be read */
+static int alien_getvalue(lua_State *L, char *b, int type) {
+  void *p;
+  switch(type) {
+  case AT_byte: lua_pushnumber(L, (signed char)*b); break;
+  case AT_char: lua_pushnumber(L, (unsigned char)*b); break;
+  case AT_short: lua_pushnumber(L, *((short*)b)); break;
+  case AT_ushort: lua_pushnumber(L, *((unsigned short*)b)); break;
+  case AT_int: lua_pushnumber(L, *((int*)b)); break;
+  case AT_uint: lua_pushnumber(L, *((unsigned int*)b)); break;
+  case AT_long: lua_pushnumber(L, *((long*)b)); break;
+  case AT_ulong: lua_pushnumber(L, *((unsigned long*)b)); break;
+  case AT_ptrdiff_t: lua_pushnumber(L, *((ptrdiff_t*)b)); break;
+  case AT_size_t: lua_pushnumber(L, *((size_t*)b)); break;
+  case AT_float: lua_pushnumber(L, *((float*)b)); break;
+  case AT_double: lua_pushnumber(L, *((double*)b)); break;
+  case AT_string:
+    p = *((void**)b);
+    if(p) lua_pushstring(L, (const char *)p); else lua_pushnil(L);
+    break;
+  case AT_pointer:
+    p = *((void**)b);
+    p ? lua_pushlightuserdata(L, p) : lua_pushnil(L);
+    break;
+  case AT_callback:
+    p = *((void**)b);
+    p ? alien_makefunction(L, NULL, p, NULL) : lua_pushnil(L);
+    break;
+  default:
+    return 0;
+  }
+  return 1;
+}
+
+/* Typed accessors: the element type is resolved once, when the accessor
+   or view is created, and every access is checked against the buffer
+   size (buffers wrapping a raw pointer have no size to check) */
+
+typedef struct {
+  size_t size;
+  void (*get)(lua_State *L, const char *p);
+  void (*set)(lua_State *L, int i, char *p);
+  /* bulk forms: n elements from p to t[1..n] and back */
+  void (*getn)(lua_State *L, const char *p, size_t n, int t);
+  void (*setn)(lua_State *L, int t, size_t n, char *p);
+} alien_Access;
+
+/* integer types that lua_Integer holds exactly */
+#define alien_fitsinteger(_t) \
+  (sizeof(_t) < sizeof(lua_Integer) || \
+   (sizeof(_t) == sizeof(lua_Integer) && (_t)-1 < 0))
+
+/* the bulk loops are instantiated per type, so each element is a
+   fixed-size load or store that the compiler can widen or narrow inline */
+#define ALIEN_ACCESS_BULK(_b, _t) \
+  static void ALIEN_SPLICE(alien_access_getn_, _b)(lua_State *L, const char *p, size_t n, int t) { \
+    size_t j; \
+    for(j = 0; j < n; j++) { \
+      ALIEN_SPLICE(alien_access_get_, _b)(L, p + j * sizeof(_t)); \
+      lua_rawseti(L, t, (int)j + 1); \
+    } \
+  } \
+  static void ALIEN_SPLICE(alien_access_setn_, _b)(lua_State *L, int t, size_t n, char *p) { \
+    size_t j; \
+    for(j = 0; j < n; j++) { \
+      lua_rawgeti(L, t, (int)j + 1); \
+      ALIEN_SPLICE(alien_access_set_, _b)(L, -1, p + j * sizeof(_t)); \
+      lua_pop(L, 1); \
+    } \
+  }
+
+#define ALIEN_ACCESS_INT(_b, _t) \
+  static void ALIEN_SPLICE(alien_access_get_, _b)(lua_State *L, const char *p) { \
+    _t v; memcpy(&v, p, sizeof(_t)); \
+    if(alien_fitsinteger(_t)) lua_pushinteger(L, (lua_Integer)v); \
+    else lua_pushnumber(L, (lua_Number)v); \
+  } \
+  static void ALIEN_SPLICE(alien_access_set_, _b)(lua_State *L, int i, char *p) { \
+    _t v = alien_fitsinteger(_t) ? (_t)luaL_checkinteger(L, i) : (_t)luaL_checknumber(L, i); \
+    memcpy(p, &v, sizeof(_t)); \
+  } \
+  ALIEN_ACCESS_BULK(_b, _t)
+
+#define ALIEN_ACCESS_FLT(_b, _t) \
+  static void ALIEN_SPLICE(alien_access_get_, _b)(lua_State *L, const char *p) { \
+    _t v; memcpy(&v, p, sizeof(_t)); lua_pushnumber(L, v); \
+  } \
+  static void ALIEN_SPLICE(alien_access_set_, _b)(lua_State *L, int i, char *p) { \
+    _t v = (_t)luaL_checknumber(L, i); memcpy(p, &v, sizeof(_t)); \
+  } \
+  ALIEN_ACCESS_BULK(_b, _t)
+
+ALIEN_ACCESS_INT(byte, signed char)
+ALIEN_ACCESS_INT(char, unsigned char)
+ALIEN_ACCESS_INT(short, short)
+ALIEN_ACCESS_INT(ushort, unsigned short)
+ALIEN_ACCESS_INT(int, int)
+ALIEN_ACCESS_INT(uint, unsigned int)
+ALIEN_ACCESS_INT(long, long)
+ALIEN_ACCESS_INT(ulong, unsigned long)
+ALIEN_ACCESS_INT(ptrdiff_t, ptrdiff_t)
+ALIEN_ACCESS_INT(size_t, size_t)
+ALIEN_ACCESS_INT(longlong, long long)
+ALIEN_ACCESS_INT(ulonglong, unsigned long long)
+ALIEN_ACCESS_FLT(float, float)
+ALIEN_ACCESS_FLT(double, double)
+
+static void alien_access_get_pointer(lua_State *L, const char *p) {
+  void *v;
+  memcpy(&v, p, sizeof(void *));
+  v ? lua_pushlightuserdata(L, v) : lua_pushnil(L);
+}
+
+static void alien_access_set_pointer(lua_State *L, int i, char *p) {
+  void *v = alien_touserdata(L, i);
+  if(!v && !lua_isnil(L, i)) luaL_typerror(L, i, "userdata");
+  memcpy(p, &v, sizeof(void *));
+}
+
+ALIEN_ACCESS_BULK(pointer, void *)
+
+#define ALIEN_ACCESS_ENTRY(_b, _t) \
+  { sizeof(_t), ALIEN_SPLICE(alien_access_get_, _b), ALIEN_SPLICE(alien_access_set_, _b), \
+    ALIEN_SPLICE(alien_access_getn_, _b), ALIEN_SPLICE(alien_access_setn_, _b) }
+
+/* accessors by alien_Type; types without one have a zero size */
+static const alien_Access alien_accesses[] = {
+  { 0, NULL, NULL, NULL, NULL },                               /* void */
+  ALIEN_ACCESS_ENTRY(byte, signed char),
+  ALIEN_ACCESS_ENTRY(char, unsigned char),
+  ALIEN_ACCESS_ENTRY(short, short),
+  ALIEN_ACCESS_ENTRY(ushort, unsigned short),
+  ALIEN_ACCESS_ENTRY(int, int),
+  ALIEN_ACCESS_ENTRY(uint, unsigned int),
+  ALIEN_ACCESS_ENTRY(long, long),
+  ALIEN_ACCESS_ENTRY(ulong, unsigned long),
+  ALIEN_ACCESS_ENTRY(ptrdiff_t, ptrdiff_t),
+  ALIEN_ACCESS_ENTRY(size_t, size_t),
+  ALIEN_ACCESS_ENTRY(float, float),
+  ALIEN_ACCESS_ENTRY(double, double),
+  { 0, NULL, NULL, NULL, NULL },                               /* string */
+  ALIEN_ACCESS_ENTRY(pointer, void *),
+  { 0, NULL, NULL, NULL, NULL }, { 0, NULL, NULL, NULL, NULL },            /* ref char, ref int */
+  { 0, NULL, NULL, NULL, NULL }, { 0, NULL, NULL, NULL, NULL },            /* ref uint, ref double */
+  ALIEN_ACCESS_ENTRY(longlong, long long),
+  ALIEN_ACCESS_ENTRY(ulonglong, unsigned long long),
+  { 0, NULL, NULL, NULL, NULL }                                /* callback */
+};
+
+/* fixed-width names of buffer views, and the alien types they map to */
+static const char *const alien_viewnames[] = {
+  "i8", "u8", "i16", "u16", "i32", "u32", "i64", "u64", "f32", "f64", "ptr", NULL
+};
+static const alien_Type alien_viewtypes[] = {
+  AT_byte, AT_char, AT_short, AT_ushort, AT_int, AT_uint,
+  AT_longlong, AT_ulonglong, AT_float, AT_double, AT_pointer
+};
+
+typedef struct {
+  alien_Buffer *ab;
+  const alien_Access *acc;
+} alien_View;
+
+/* address of len bytes at 0-based offset in ab */
+static char *alien_buffer_range(lua_State *L, alien_Buffer *ab, lua_Integer offset,
+                                size_t len, int arg) {
+  if(offset < 0 || (ab->size > 0 && (size_t)offset + len > ab->size) ||
+     (ab->size == 0 && ab->p == &alien_buffer_empty))
+    luaL_argerror(L, arg, "out of buffer bounds");
+  return ab->p + offset;
+}
+
+/* address of the element of acc at 0-based byte offset in ab */
+#define alien_access_at(L, ab, acc, offset, arg) \
+  alien_buffer_range(L, ab, offset, (acc)->size, arg)
+
+static const alien_Access *alien_checkaccessor(lua_State *L, int index) {
+  return *(const alien_Access **)luaL_checkudata(L, index, ALIEN_ACCESSOR_META);
+}
+
+static int alien_accessor_new(lua_State *L) {
+  const alien_Access *acc = &alien_accesses[luaL_checkoption(L, 1, NULL, alien_typenames)];
+  const alien_Access **ud;
+  if(acc->size == 0)
+    return luaL_argerror(L, 1, "type has no accessor");
+  ud = (const alien_Access **)lua_newuserdata(L, sizeof(const alien_Access *));
+  *ud = acc;
+  luaL_getmetatable(L, ALIEN_ACCESSOR_META);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+/* accessor:get(buf, offset), with the 1-based byte offset of buf:get */
+static int alien_accessor_get(lua_State *L) {
+  const alien_Access *acc = alien_checkaccessor(L, 1);
+  alien_Buffer *ab = alien_checkbuffer(L, 2);
+  acc->get(L, alien_access_at(L, ab, acc, luaL_checkinteger(L, 3) - 1, 3));
+  return 1;
+}
+
+/* accessor:set(buf, offset, value) */
+static int alien_accessor_set(lua_State *L) {
+  const alien_Access *acc = alien_checkaccessor(L, 1);
+  alien_Buffer *ab = alien_checkbuffer(L, 2);
+  acc->set(L, 4, alien_access_at(L, ab, acc, luaL_checkinteger(L, 3) - 1, 3));
+  return 0;
+}
+
+static int alien_accessor_size(lua_State *L) {
+  lua_pushinteger(L, alien_checkaccessor(L, 1)->size);
+  return 1;
+}
+
+/* view[i], with i the 1-based element index */
+static int alien_view_get(lua_State *L) {
+  alien_View *v = (alien_View *)luaL_checkudata(L, 1, ALIEN_VIEW_META);
+  lua_Integer i = luaL_checkinteger(L, 2) - 1;
+  v->acc->get(L, alien_access_at(L, v->ab, v->acc, i * (lua_Integer)v->acc->size, 2));
+  return 1;
+}
+
+static int alien_view_set(lua_State *L) {
+  alien_View *v = (alien_View *)luaL_checkudata(L, 1, ALIEN_VIEW_META);
+  lua_Integer i = luaL_checkinteger(L, 2) - 1;
+  v->acc->set(L, 3, alien_access_at(L, v->ab, v->acc, i * (lua_Integer)v->acc->size, 2));
+  return 0;
+}
+
+static int alien_view_length(lua_State *L) {
+  alien_View *v = (alien_View *)luaL_checkudata(L, 1, ALIEN_VIEW_META);
+  lua_pushinteger(L, v->ab->size / v->acc->size);
+  return 1;
+}
+
+static const alien_Access *alien_checkbulktype(lua_State *L, int arg) {
+  const alien_Access *acc = &alien_accesses[luaL_checkoption(L, arg, NULL, alien_typenames)];
+  if(acc->size == 0)
+    luaL_argerror(L, arg, "type has no accessor");
+  return acc;
+}
+
+/* buf:getarray(offset, type, n, [t]) reads n elements into t (or a
+   new table) in one call */
+static int alien_buffer_getarray(lua_State *L) {
+  alien_Buffer *ab = alien_checkbuffer(L, 1);
+  lua_Integer offset = luaL_checkinteger(L, 2) - 1;
+  const alien_Access *acc = alien_checkbulktype(L, 3);
+  lua_Integer n = luaL_checkinteger(L, 4);
+  char *p;
+  luaL_argcheck(L, n >= 0 && (size_t)n <= (size_t)INT_MAX / acc->size, 4, "invalid count");
+  p = alien_buffer_range(L, ab, offset, (size_t)n * acc->size, 2);
+  if(lua_isnoneornil(L, 5))
+    lua_createtable(L, (int)n, 0);
+  else {
+    luaL_checktype(L, 5, LUA_TTABLE);
+    lua_settop(L, 5);
+  }
+  acc->getn(L, p, (size_t)n, lua_gettop(L));
+  return 1;
+}
+
+/* buf:setarray(offset, type, t | s) writes the elements of t, or the
+   raw bytes of s, starting at offset; returns the element count */
+static int alien_buffer_setarray(lua_State *L) {
+  alien_Buffer *ab = alien_checkbuffer(L, 1);
+  lua_Integer offset = luaL_checkinteger(L, 2) - 1;
+  const alien_Access *acc = alien_checkbulktype(L, 3);
+  size_t n;
+  if(lua_type(L, 4) == LUA_TSTRING) {
+    size_t len;
+    const char *s = lua_tolstring(L, 4, &len);
+    luaL_argcheck(L, len % acc->size == 0, 4, "length is not a multiple of the element size");
+    memcpy(alien_buffer_range(L, ab, offset, len, 2), s, len);
+    n = len / acc->size;
+  } else {
+    luaL_checktype(L, 4, LUA_TTABLE);
+    n = lua_objlen(L, 4);
+    acc->setn(L, 4, n, alien_buffer_range(L, ab, offset, n * acc->size, 2));
+  }
+  lua_pushinteger(L, (lua_Integer)n);
+  return 1;
+}
+
+/* false candidates from memchr (at most ALIEN_FIND_GAP bytes apart on
+   average) after which alien_memfind switches to a skip table */
+#define ALIEN_FIND_MISSES 16
+#define ALIEN_FIND_GAP 8
+
+/* Horspool search for p (lp >= 2) starting in [s, end) */
+static const char *alien_skipfind(const char *s, const char *end,
+                                  const char *p, size_t lp) {
+  size_t skip[UCHAR_MAX + 1];
+  size_t i, last = lp - 1;
+  for(i = 0; i <= UCHAR_MAX; i++)
+    skip[i] = lp;
+  for(i = 0; i < last; i++)
+    skip[(unsigned char)p[i]] = last - i;
+  while(s < end) {
+    unsigned char c = (unsigned char)s[last];
+    if(c == (unsigned char)p[last] && memcmp(s, p, last) == 0)
+      return s;
+    s += skip[c];
+  }
+  return NULL;
+}
+
+/* first occurrence of the lp bytes at p in the ls bytes at s, or NULL;
+   memchr on the first byte, unless the data is too repetitive for it */
+static const char *alien_memfind(const char *s, size_t ls,
+                                 const char *p, size_t lp) {
+  const char *init = s, *end;
+  size_t last, misses = 0;
+  if(lp == 0) return s;
+  if(lp > ls) return NULL;
+  end = s + (ls - lp) + 1;
+  last = lp - 1;
+  while(s < end && (s = (const char *)memchr(s, *p, end - s)) != NULL) {
+    if(s[last] == p[last] && memcmp(s + 1, p + 1, last) == 0)
+      return s;
+    s++;
+    if(++misses >= ALIEN_FIND_MISSES && last > 0 &&
+       (size_t)(s - init) < misses * ALIEN_FIND_GAP)
+      return alien_skipfind(s, end, p, lp);
+  }
+  return NULL;
+}
+
+/* buf:find(s, [offset], [len]) looks for the bytes of s in the len bytes
+   (default: up to the end) from offset (default 1) on, and returns the
+   offset where they start, or nil */
+static int alien_buffer_find(lua_State *L) {
+  alien_Buffer *ab = alien_checkbuffer(L, 1);
+  size_t lp;
+  const char *p = luaL_checklstring(L, 2, &lp);
+  lua_Integer offset = luaL_optinteger(L, 3, 1) - 1;
+  size_t len;
+  const char *b, *res;
+  if(lua_isnoneornil(L, 4)) {
+    if(ab->size == 0)
+      return luaL_argerror(L, 4, "length needed for a buffer of unknown size");
+    luaL_argcheck(L, offset >= 0 && (size_t)offset <= ab->size, 3, "out of buffer bounds");
+    len = ab->size - (size_t)offset;
+  } else {
+    lua_Integer n = luaL_checkinteger(L, 4);
+    luaL_argcheck(L, n >= 0, 4, "negative length");
+    len = (size_t)n;
+  }
+  b = alien_buffer_range(L, ab, offset, len, 3);
+  res = alien_memfind(b, len, p, lp);
+  if(res)
+    lua_pushinteger(L, (lua_Integer)(res - ab->p) + 1);
+  else
+    lua_pushnil(L);
+  return 1;
+}
+
+/* For buf.<name> with a view name, pushes the view (created once and
+   then kept in the buffer's uservalue table) and returns 1 */
+static int alien_buffer_view(lua_State *L) {
+  const char *name = lua_tostring(L, 2);
+  alien_View *v;
+  int i;
+  for(i = 0; alien_viewnames[i]; i++)
+    if(strcmp(alien_viewnames[i], name) == 0) break;
+  if(!alien_viewnames[i]) return 0;
+  lua_getuservalue(L, 1);
+  if(lua_isnil(L, -1)) {
+    lua_pop(L, 1);
+    lua_newtable(L);
+    lua_pushvalue(L, -1);
+    lua_setuservalue(L, 1);
+  }
+  v = (alien_View *)lua_newuserdata(L, sizeof(alien_View));
+  v->ab = alien_checkbuffer(L, 1);
+  v->acc = &alien_accesses[alien_viewtypes[i]];
+  luaL_getmetatable(L, ALIEN_VIEW_META);
+  lua_setmetatable(L, -2);
+  lua_pushvalue(L, 1);  /* the view keeps its buffer alive */
+  lua_setuservalue(L, -2);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -3, name);
+  return 1;
+}
+
 static int alien_buffer_get(lua_State *L) {
   static const void* funcs[] = {&alien_buffer_tostring,
                                 &alien_buffer_topointer,
@@ -1042,49 +1722,447 @@ static int alien_buffer_get(lua_State *L) {
                                 &alien_buffer_strlen,
                                 &alien_buffer_get,
                                 &alien_buffer_set,
-                                &alien_buffer_realloc};
-  static const char *const funcnames[] = { "tostring", "topointer", "tooffset", "strlen", "get", "set", "realloc", NULL };
+                                &alien_buffer_realloc,
+                                &alien_buffer_getarray,
+                                &alien_buffer_setarray,
+                                &alien_buffer_find};
+  static const char *const funcnames[] = { "tostring", "topointer", "tooffset", "strlen", "get", "set", "realloc",
+                                           "getarray", "setarray", "find", NULL };
   char *b = alien_checkbuffer(L, 1)->p;
   if(lua_type(L, 2) == LUA_TSTRING) {
     lua_getuservalue(L, 1);
     if(!lua_isnil(L, -1))
       lua_getfield(L, -1, lua_tostring(L, 2));
-    if(lua_isnil(L, -1))
+    if(lua_isnil(L, -1) && !alien_buffer_view(L))
       lua_pushcfunction(L,
                         (lua_CFunction)funcs[luaL_checkoption(L, 2, "tostring", funcnames)]);
   } else {
-    void *p;
     ptrdiff_t offset = luaL_checkinteger(L, 2) - 1;
     int type = luaL_checkoption(L, 3, "char", alien_typenames);
-    switch(type) {
-    case AT_byte: lua_pushnumber(L, (signed char)b[offset]); break;
-    case AT_char: lua_pushnumber(L, (unsigned char)b[offset]); break;
-    case AT_short: lua_pushnumber(L, *((short*)(&b[offset]))); break;
-    case AT_ushort: lua_pushnumber(L, *((unsigned short*)(&b[offset]))); break;
-    case AT_int: lua_pushnumber(L, *((int*)(&b[offset]))); break;
-    case AT_uint: lua_pushnumber(L, *((unsigned int*)(&b[offset]))); break;
-    case AT_long: lua_pushnumber(L, *((long*)(&b[offset]))); break;
-    case AT_ulong: lua_pushnumber(L, *((unsigned long*)(&b[offset]))); break;
-    case AT_ptrdiff_t: lua_pushnumber(L, *((ptrdiff_t*)(&b[offset]))); break;
-    case AT_size_t: lua_pushnumber(L, *((size_t*)(&b[offset]))); break;
-    case AT_float: lua_pushnumber(L, *((float*)(&b[offset]))); break;
-    case AT_double: lua_pushnumber(L, *((double*)(&b[offset]))); break;
-    case AT_string:
-      p = *((void**)&b[offset]);
-      if(p) lua_pushstring(L, (const char *)p); else lua_pushnil(L);
-      break;
-    case AT_pointer:
-      p = *((void**)&b[offset]);
-      p ? lua_pushlightuserdata(L, p) : lua_pushnil(L);
-      break;
-    case AT_callback:
-      p = *((void**)&b[offset]);
-      p ? alien_makefunction(L, NULL, p, NULL) : lua_pushnil(L);
-      break;
-    default:
+    if(!alien_getvalue(L, &b[offset], type))
       return luaL_error(L, "alien: unknown type in buffer:get");
+  }
+  return 1;
+}
+
+/* pushes the value of type at p, through its accessor if it has one */
+static void alien_pushelem(lua_State *L, char *p, alien_Type type) {
+  const alien_Access *acc = &alien_accesses[type];
+  if(acc->size > 0)
+    acc->get(L, p);
+  else if(!alien_getvalue(L, p, type))
+    luaL_error(L, "alien: unknown type %s", alien_typenames[type]);
+}
+
+/* stores the value at index i into p as type; strings stored into
+   pointers are copied into the memory already pointed to, as with
+   buffer:set */
+static void alien_storeelem(lua_State *L, char *p, alien_Type type, int i) {
+  const alien_Access *acc = &alien_accesses[type];
+  if(acc->size > 0 && !(type == AT_pointer && lua_type(L, i) == LUA_TSTRING))
+    acc->set(L, i, p);
+  else if(!alien_setvalue(L, p, type, i))
+    luaL_error(L, "alien: unknown type %s", alien_typenames[type]);
+}
+
+/* Arrays: typed elements over a buffer, indexed from 1. The uservalue
+   table holds the buffer, the values that pointer elements refer to
+   (pinned by absolute element index, so slices share them) and any
+   fields the user sets */
+
+static alien_Array *alien_checkarray(lua_State *L, int index) {
+  return (alien_Array *)luaL_checkudata(L, index, ALIEN_ARRAY_META);
+}
+
+/* address of element i of arr */
+static char *alien_array_at(lua_State *L, alien_Array *arr, lua_Integer i) {
+  size_t end;
+  if(i < 1 || (size_t)i > arr->length)
+    luaL_error(L, "array access out of bounds");
+  end = (arr->first + (size_t)i) * arr->size;
+  if(arr->ab->size > 0 && end > arr->ab->size)
+    luaL_error(L, "array access out of bounds");
+  return arr->ab->p + end - arr->size;
+}
+
+#define alien_array_getelem(L, arr, i) \
+  alien_pushelem(L, alien_array_at(L, arr, i), (arr)->type)
+
+/* keeps the value on top of the stack alive while element i of the
+   array at index points into it; pops the value */
+static void alien_array_pin(lua_State *L, int index, alien_Array *arr, lua_Integer i) {
+  lua_getuservalue(L, index);
+  lua_getfield(L, -1, "pinned");
+  lua_pushvalue(L, -3);
+  lua_rawseti(L, -2, (int)(arr->first + i));
+  lua_pop(L, 3);
+}
+
+/* stores the value at index v as element i of the array at index */
+static void alien_array_setelem(lua_State *L, int index, alien_Array *arr,
+                                lua_Integer i, int v) {
+  char *p = alien_array_at(L, arr, i);
+  if(arr->type == AT_pointer || arr->type == AT_string) {
+    void *ptr;
+    if(lua_type(L, v) == LUA_TSTRING) { /* C gets its own copy */
+      lua_pushcfunction(L, alien_buffer_new);
+      lua_pushvalue(L, v);
+      lua_call(L, 1, 1);
+      ptr = alien_checkbuffer(L, -1)->p;
+    } else {
+      ptr = alien_touserdata(L, v);
+      if(!ptr && !lua_isnil(L, v)) luaL_typerror(L, v, "userdata");
+      lua_pushvalue(L, v);
     }
+    memcpy(p, &ptr, sizeof(void *));
+    alien_array_pin(L, index, arr, i);
+  } else
+    alien_storeelem(L, p, arr->type, v);
+}
+
+static alien_Array *alien_array_push(lua_State *L) {
+  alien_Array *arr = (alien_Array *)lua_newuserdata(L, sizeof(alien_Array));
+  luaL_getmetatable(L, ALIEN_ARRAY_META);
+  lua_setmetatable(L, -2);
+  return arr;
+}
+
+/* alien.array(type, length, [init | buffer]) or alien.array(type, init) */
+static int alien_array_new(lua_State *L) {
+  int type = luaL_checkoption(L, 1, NULL, alien_typenames);
+  int init = 0;
+  size_t length;
+  alien_Array *arr;
+  if(lua_istable(L, 2)) {
+    init = 2;
+    length = lua_objlen(L, 2);
+  } else {
+    lua_Integer n = luaL_checkinteger(L, 2);
+    luaL_argcheck(L, n >= 0, 2, "negative length");
+    length = (size_t)n;
+    if(lua_istable(L, 3)) init = 3;
+  }
+  lua_settop(L, 3);
+  arr = alien_array_push(L);
+  arr->type = (alien_Type)type;
+  arr->size = alien_sizes[type];
+  arr->first = 0;
+  arr->length = length;
+  arr->slice = 0;
+  lua_createtable(L, 0, 2);
+  if(!init && !lua_isnil(L, 3)) {
+    alien_checkbuffer(L, 3);
+    lua_pushvalue(L, 3);
+  } else {
+    lua_pushcfunction(L, alien_buffer_new);
+    lua_pushinteger(L, (lua_Integer)(arr->size * length));
+    lua_call(L, 1, 1);
+  }
+  arr->ab = (alien_Buffer *)lua_touserdata(L, -1);
+  lua_setfield(L, -2, "buffer");
+  lua_newtable(L);
+  lua_setfield(L, -2, "pinned");
+  lua_setuservalue(L, 4);
+  if(init) {
+    size_t i;
+    for(i = 1; i <= length; i++) {
+      lua_rawgeti(L, init, (int)i);
+      alien_array_setelem(L, 4, arr, (lua_Integer)i, 5);
+      lua_pop(L, 1);
+    }
+  }
+  return 1;
+}
+
+static int alien_array_get(lua_State *L) {
+  alien_Array *arr = alien_checkarray(L, 1);
+  const char *k;
+  if(lua_type(L, 2) == LUA_TNUMBER) {
+    alien_array_getelem(L, arr, luaL_checkinteger(L, 2));
+    return 1;
+  }
+  k = lua_tostring(L, 2);
+  if(k && strcmp(k, "length") == 0)
+    lua_pushinteger(L, (lua_Integer)arr->length);
+  else if(k && strcmp(k, "size") == 0)
+    lua_pushinteger(L, (lua_Integer)arr->size);
+  else if(k && strcmp(k, "type") == 0)
+    lua_pushstring(L, alien_typenames[arr->type]);
+  else {
+    lua_getuservalue(L, 1);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    if(lua_isnil(L, -1)) {
+      lua_pushvalue(L, 2);
+      lua_rawget(L, lua_upvalueindex(1)); /* methods */
+    }
+  }
+  return 1;
+}
+
+static int alien_array_set(lua_State *L) {
+  static const char *const fixed[] = { "length", "size", "type", "buffer", "pinned", NULL };
+  alien_Array *arr = alien_checkarray(L, 1);
+  if(lua_type(L, 2) == LUA_TNUMBER)
+    alien_array_setelem(L, 1, arr, luaL_checkinteger(L, 2), 3);
+  else {
+    if(lua_type(L, 2) == LUA_TSTRING) {
+      const char *k = lua_tostring(L, 2);
+      int i;
+      for(i = 0; fixed[i]; i++)
+        if(strcmp(k, fixed[i]) == 0)
+          return luaL_error(L, "alien: array field %s is read-only", k);
+    }
+    lua_getuservalue(L, 1);
+    lua_pushvalue(L, 2);
+    lua_pushvalue(L, 3);
+    lua_settable(L, -3);
   }
+  return 0;
+}
+
+static int alien_array_length(lua_State *L) {
+  lua_pushinteger(L, (lua_Integer)alien_checkarray(L, 1)->length);
+  return 1;
+}
+
+static int alien_array_next(lua_State *L) {
+  alien_Array *arr = alien_checkarray(L, 1);
+  lua_Integer i = luaL_checkinteger(L, 2) + 1;
+  if(i > (lua_Integer)arr->length) return 0;
+  lua_pushinteger(L, i);
+  alien_array_getelem(L, arr, i);
+  return 2;
+}
+
+static int alien_array_ipairs(lua_State *L) {
+  alien_checkarray(L, 1);
+  lua_pushcfunction(L, alien_array_next);
+  lua_pushvalue(L, 1);
+  lua_pushinteger(L, 0);
+  return 3;
+}
+
+static int alien_array_realloc(lua_State *L) {
+  alien_Array *arr = alien_checkarray(L, 1);
+  lua_Integer n = luaL_checkinteger(L, 2);
+  luaL_argcheck(L, n >= 0, 2, "negative length");
+  if(arr->slice)
+    return luaL_error(L, "alien: cannot realloc an array slice");
+  lua_pushcfunction(L, alien_buffer_realloc);
+  lua_getuservalue(L, 1);
+  lua_getfield(L, -1, "buffer");
+  lua_remove(L, -2);
+  lua_pushinteger(L, n * (lua_Integer)arr->size);
+  lua_call(L, 2, 0);
+  arr->length = (size_t)n;
+  return 0;
+}
+
+/* arr:slice(i, [j]) is an array of elements i..j of arr that shares
+   its buffer, so nothing is copied */
+static int alien_array_slice(lua_State *L) {
+  alien_Array *arr = alien_checkarray(L, 1), *s;
+  lua_Integer i = luaL_checkinteger(L, 2);
+  lua_Integer j = luaL_optinteger(L, 3, (lua_Integer)arr->length);
+  luaL_argcheck(L, i >= 1 && i <= (lua_Integer)arr->length + 1, 2, "out of array bounds");
+  luaL_argcheck(L, j <= (lua_Integer)arr->length, 3, "out of array bounds");
+  s = alien_array_push(L);
+  *s = *arr;
+  s->first = arr->first + (size_t)i - 1;
+  s->length = j < i ? 0 : (size_t)(j - i + 1);
+  s->slice = 1;
+  lua_getuservalue(L, 1);
+  lua_createtable(L, 0, 2);
+  lua_getfield(L, -2, "buffer");
+  lua_setfield(L, -2, "buffer");
+  lua_getfield(L, -2, "pinned");
+  lua_setfield(L, -2, "pinned");
+  lua_setuservalue(L, -3);
+  lua_pop(L, 1);
+  return 1;
+}
+
+static int alien_array_topointer(lua_State *L) {
+  lua_pushlightuserdata(L, alien_arraydata(alien_checkarray(L, 1)));
+  return 1;
+}
+
+/* Structs: alien.defstruct computes offsets once into a layout, and
+   instances resolve a field name to its offset and type with a single
+   lookup in the layout's field table */
+
+static const alien_Layout *alien_checklayout(lua_State *L, int index) {
+  return (const alien_Layout *)luaL_checkudata(L, index, ALIEN_LAYOUT_META);
+}
+
+/* alien.defstruct{ { name, type }, ... } */
+static int alien_layout_new(lua_State *L) {
+  alien_Layout *lt;
+  size_t off = 0;
+  int i, n;
+  luaL_checktype(L, 1, LUA_TTABLE);
+  n = (int)lua_objlen(L, 1);
+  lt = (alien_Layout *)lua_newuserdata(L, sizeof(alien_Layout) +
+                                       (n > 0 ? n - 1 : 0) * sizeof(alien_Field));
+  lt->align = 1;
+  lt->nfields = n;
+  luaL_getmetatable(L, ALIEN_LAYOUT_META);
+  lua_setmetatable(L, -2);
+  lua_createtable(L, 0, 4);     /* uservalue */
+  lua_createtable(L, n, 0);     /* names */
+  lua_createtable(L, 0, n);     /* offsets */
+  lua_createtable(L, 0, n);     /* types */
+  lua_createtable(L, 0, n);     /* fields */
+  for(i = 0; i < n; i++) {
+    alien_Field *f = &lt->fields[i];
+    const char *tname;
+    int t;
+    lua_rawgeti(L, 1, i + 1);
+    if(!lua_istable(L, -1))
+      return luaL_error(L, "alien: struct field %d is not a { name, type } pair", i + 1);
+    lua_rawgeti(L, -1, 1);
+    lua_rawgeti(L, -2, 2);
+    tname = lua_tostring(L, -1);
+    if(!lua_isstring(L, -2) || !tname)
+      return luaL_error(L, "alien: struct field %d is not a { name, type } pair", i + 1);
+    for(t = 0; alien_typenames[t]; t++)
+      if(strcmp(alien_typenames[t], tname) == 0) break;
+    if(!alien_typenames[t] || t == AT_void)
+      return luaL_error(L, "alien: invalid type %s for struct field %s",
+                        tname, lua_tostring(L, -2));
+    f->type = (alien_Type)t;
+    off = (off + alien_aligns[t] - 1) / alien_aligns[t] * alien_aligns[t];
+    f->offset = off;
+    off += alien_sizes[t];
+    if(alien_aligns[t] > lt->align) lt->align = alien_aligns[t];
+    /* stack: names offsets types fields pair name type */
+    lua_pushvalue(L, -2);
+    lua_rawseti(L, -8, i + 1);
+    lua_pushvalue(L, -2);
+    lua_pushinteger(L, (lua_Integer)f->offset);
+    lua_rawset(L, -8);
+    lua_pushvalue(L, -2);
+    lua_pushvalue(L, -2);
+    lua_rawset(L, -7);
+    lua_pushvalue(L, -2);
+    lua_pushlightuserdata(L, f);
+    lua_rawset(L, -6);
+    lua_pop(L, 3);
+  }
+  lt->size = (off + lt->align - 1) / lt->align * lt->align;
+  lua_setfield(L, -5, "fields");
+  lua_setfield(L, -4, "types");
+  lua_setfield(L, -3, "offsets");
+  lua_setfield(L, -2, "names");
+  lua_setuservalue(L, -2);
+  return 1;
+}
+
+static int alien_layout_get(lua_State *L) {
+  const alien_Layout *lt = alien_checklayout(L, 1);
+  const char *k = lua_tostring(L, 2);
+  if(k && strcmp(k, "size") == 0)
+    lua_pushinteger(L, (lua_Integer)lt->size);
+  else if(k && strcmp(k, "align") == 0)
+    lua_pushinteger(L, (lua_Integer)lt->align);
+  else {
+    lua_getuservalue(L, 1);
+    lua_pushvalue(L, 2);
+    lua_rawget(L, -2);
+    if(lua_isnil(L, -1)) {
+      lua_pushvalue(L, 2);
+      lua_rawget(L, lua_upvalueindex(1)); /* methods */
+    }
+  }
+  return 1;
+}
+
+/* layout:new([buffer | pointer]) */
+static int alien_layout_instance(lua_State *L) {
+  const alien_Layout *lt = alien_checklayout(L, 1);
+  alien_Struct *st;
+  lua_settop(L, 2);
+  st = (alien_Struct *)lua_newuserdata(L, sizeof(alien_Struct));
+  st->layout = lt;
+  luaL_getmetatable(L, ALIEN_STRUCT_META);
+  lua_setmetatable(L, -2);
+  lua_createtable(L, 3, 0);
+  if(luaL_testudata(L, 2, ALIEN_BUFFER_META))
+    lua_pushvalue(L, 2);
+  else {
+    lua_pushcfunction(L, alien_buffer_new);
+    if(lua_isnil(L, 2))
+      lua_pushinteger(L, (lua_Integer)lt->size);
+    else {
+      luaL_checktype(L, 2, LUA_TLIGHTUSERDATA);
+      lua_pushvalue(L, 2);
+    }
+    lua_call(L, 1, 1);
+  }
+  st->ab = (alien_Buffer *)lua_touserdata(L, -1);
+  lua_rawseti(L, -2, 1);
+  lua_getuservalue(L, 1);
+  lua_getfield(L, -1, "fields");
+  lua_rawseti(L, -3, 2);
+  lua_pop(L, 1);
+  lua_pushvalue(L, 1);
+  lua_rawseti(L, -2, 3);
+  lua_setuservalue(L, -2);
+  return 1;
+}
+
+/* the argument types that pass a struct of this layout by value */
+static int alien_layout_byval(lua_State *L) {
+  size_t size = alien_checklayout(L, 1)->size, i;
+  int n = 0;
+  for(i = 0; i < size; i += 4, n++) {
+    luaL_checkstack(L, 1, "struct too large");
+    lua_pushstring(L, size - i == 1 ? "char" : size - i == 2 ? "short" : "int");
+  }
+  return n;
+}
+
+/* address of the field named by the key at index 2 */
+static char *alien_struct_field(lua_State *L, alien_Struct *st, alien_Type *type) {
+  const alien_Field *f;
+  lua_getuservalue(L, 1);
+  lua_rawgeti(L, -1, 2);
+  lua_pushvalue(L, 2);
+  lua_rawget(L, -2);
+  f = (const alien_Field *)lua_touserdata(L, -1);
+  lua_pop(L, 3);
+  if(!f) {
+    luaL_error(L, "field %s does not exist", lua_isstring(L, 2) ? lua_tostring(L, 2) : "?");
+    return NULL;
+  }
+  if(st->ab->size > 0 && f->offset + alien_sizes[f->type] > st->ab->size)
+    luaL_error(L, "field %s is out of buffer bounds", lua_tostring(L, 2));
+  *type = f->type;
+  return st->ab->p + f->offset;
+}
+
+static int alien_struct_get(lua_State *L) {
+  alien_Struct *st = (alien_Struct *)luaL_checkudata(L, 1, ALIEN_STRUCT_META);
+  alien_Type type;
+  char *p = alien_struct_field(L, st, &type);
+  alien_pushelem(L, p, type);
+  return 1;
+}
+
+static int alien_struct_set(lua_State *L) {
+  alien_Struct *st = (alien_Struct *)luaL_checkudata(L, 1, ALIEN_STRUCT_META);
+  alien_Type type;
+  char *p = alien_struct_field(L, st, &type);
+  alien_storeelem(L, p, type, 3);
+  return 0;
+}
+
+/* s() is the underlying buffer */
+static int alien_struct_buffer(lua_State *L) {
+  luaL_checkudata(L, 1, ALIEN_STRUCT_META);
+  lua_getuservalue(L, 1);
+  lua_rawgeti(L, -1, 1);
   return 1;
 }
 
@@ -1211,6 +2289,9 @@ static const luaL_Reg alienlib[] = {
   {"tofloat", alien_udata2float},
   {"todouble", alien_udata2double},
   {"buffer", alien_buffer_new},
+  {"accessor", alien_accessor_new},
+  {"array", alien_array_new},
+  {"defstruct", alien_layout_new},
   {"callback", alien_callback_new},
   {"funcptr", alien_function_new},
   {"table", alien_table_new},
@@ -1229,6 +2310,7 @@ static const luaL_Reg alienlib[] = {
 
 int luaopen_alien_c(lua_State *L) {
   alien_Library *al;
+  alien_State *st;
 
   #ifdef WINDOWS
 
@@ -1255,6 +2337,15 @@ int luaopen_alien_c(lua_State *L) {
 #endif
   lua_pop(L, 1);
 
+  /* State of calls in progress, kept if the library is loaded again */
+  lua_getfield(L, LUA_REGISTRYINDEX, ALIEN_STATE_KEY);
+  if(lua_isnil(L, -1)) {
+    st = (alien_State *)lua_newuserdata(L, sizeof(alien_State));
+    st->calls = NULL;
+    lua_setfield(L, LUA_REGISTRYINDEX, ALIEN_STATE_KEY);
+  }
+  lua_pop(L, 1);
+
   /* Function metatable */
   luaL_newmetatable(L, ALIEN_FUNCTION_META);
   lua_pushliteral(L, "__index");
@@ -1264,7 +2355,8 @@ int luaopen_alien_c(lua_State *L) {
   lua_settable(L, -3);
   lua_settable(L, -3);
   lua_pushliteral(L, "__call");
-  lua_pushcfunction(L, alien_function_call);
+  lua_getfield(L, LUA_REGISTRYINDEX, ALIEN_STATE_KEY);
+  lua_pushcclosure(L, alien_function_call, 1);
   lua_settable(L, -3);
   lua_pushliteral(L, "__gc");
   lua_pushcfunction(L, alien_function_gc);
@@ -1293,6 +2385,82 @@ int luaopen_alien_c(lua_State *L) {
   lua_settable(L, -3);
   lua_pop(L, 1);
 
+  /* Accessor metatable */
+  luaL_newmetatable(L, ALIEN_ACCESSOR_META);
+  lua_pushliteral(L, "__index");
+  lua_newtable(L);
+  lua_pushcfunction(L, alien_accessor_get);
+  lua_setfield(L, -2, "get");
+  lua_pushcfunction(L, alien_accessor_set);
+  lua_setfield(L, -2, "set");
+  lua_pushcfunction(L, alien_accessor_size);
+  lua_setfield(L, -2, "size");
+  lua_settable(L, -3);
+  lua_pop(L, 1);
+
+  /* Buffer view metatable */
+  luaL_newmetatable(L, ALIEN_VIEW_META);
+  lua_pushliteral(L, "__index");
+  lua_pushcfunction(L, alien_view_get);
+  lua_settable(L, -3);
+  lua_pushliteral(L, "__newindex");
+  lua_pushcfunction(L, alien_view_set);
+  lua_settable(L, -3);
+  lua_pushliteral(L, "__len");
+  lua_pushcfunction(L, alien_view_length);
+  lua_settable(L, -3);
+  lua_pop(L, 1);
+
+  /* Array metatable */
+  luaL_newmetatable(L, ALIEN_ARRAY_META);
+  lua_pushliteral(L, "__index");
+  lua_newtable(L);
+  lua_pushcfunction(L, alien_array_ipairs);
+  lua_setfield(L, -2, "ipairs");
+  lua_pushcfunction(L, alien_array_realloc);
+  lua_setfield(L, -2, "realloc");
+  lua_pushcfunction(L, alien_array_slice);
+  lua_setfield(L, -2, "slice");
+  lua_pushcfunction(L, alien_array_topointer);
+  lua_setfield(L, -2, "topointer");
+  lua_pushcclosure(L, alien_array_get, 1);
+  lua_settable(L, -3);
+  lua_pushliteral(L, "__newindex");
+  lua_pushcfunction(L, alien_array_set);
+  lua_settable(L, -3);
+  lua_pushliteral(L, "__len");
+  lua_pushcfunction(L, alien_array_length);
+  lua_settable(L, -3);
+  lua_pushliteral(L, "__ipairs");
+  lua_pushcfunction(L, alien_array_ipairs);
+  lua_settable(L, -3);
+  lua_pop(L, 1);
+
+  /* Struct layout metatable */
+  luaL_newmetatable(L, ALIEN_LAYOUT_META);
+  lua_pushliteral(L, "__index");
+  lua_newtable(L);
+  lua_pushcfunction(L, alien_layout_instance);
+  lua_setfield(L, -2, "new");
+  lua_pushcfunction(L, alien_layout_byval);
+  lua_setfield(L, -2, "byval");
+  lua_pushcclosure(L, alien_layout_get, 1);
+  lua_settable(L, -3);
+  lua_pop(L, 1);
+
+  /* Struct metatable */
+  luaL_newmetatable(L, ALIEN_STRUCT_META);
+  lua_pushliteral(L, "__index");
+  lua_pushcfunction(L, alien_struct_get);
+  lua_settable(L, -3);
+  lua_pushliteral(L, "__newindex");
+  lua_pushcfunction(L, alien_struct_set);
+  lua_settable(L, -3);
+  lua_pushliteral(L, "__call");
+  lua_pushcfunction(L, alien_struct_buffer);
+  lua_settable(L, -3);
+  lua_pop(L, 1);
+
   /* Register main library */
   luaL_register(L, "alien", alienlib);
   /* Version */
@@ -0,0 +1,30 @@
+-- Call cost of alien functions through the direct-call trampolines and
+-- through libffi (types{..., direct = false})
+-- usage: bench_alien.lua [calls]
+
+local alien = require "alien"
+
+local dll = alien.load "alientest"
+local n = tonumber(arg and arg[1]) or 1000000
+
+local function bench(name, fname, types, ...)
+  local times = {}
+  for _, direct in ipairs{ true, false } do
+    local f = dll[fname]
+    types.direct = direct
+    f:types(types)
+    local t0 = os.clock()
+    for i = 1, n do f(...) end
+    times[#times + 1] = os.clock() - t0
+  end
+  print(string.format("%-22s direct %6.3f s   libffi %6.3f s", name, times[1], times[2]))
+end
+
+bench("int(int)", "tf_i", { ret = "int", "int" }, 7)
+bench("int(byte, int)", "tf_bi", { ret = "int", "byte", "int" }, 1, 7)
+bench("void(int, ref int)", "_testfunc_v", { ret = "void", "int", "int", "ref int" }, 1, 2, 0)
+bench("pointer(string, char)", "my_strchr", { ret = "pointer", "string", "char" }, "abc", 99)
+bench("double(double)", "tf_d", { ret = "double", "double" }, 7.5)
+bench("int(8 mixed)", "_testfunc_i_bhilpfdll",
+      { ret = "int", "byte", "short", "int", "long", "ptrdiff_t", "float", "double", "longlong" },
+      120, 1, 3, 4, 5, 6, 7, 8)
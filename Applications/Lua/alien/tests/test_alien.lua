@@ -201,6 +201,56 @@ do
   assert(r2 == 3)
 end
 
+do
+  io.write(".")
+  for _, direct in ipairs{ true, false } do
+    dll.tf_bb:types{ ret = "byte", "byte", "byte", direct = direct }
+    assert(dll.tf_bb(0, -126) == -42)
+    dll.tf_bB:types{ ret = "char", "byte", "char", direct = direct }
+    assert(dll.tf_bB(0, 255) == 85)
+    dll.tf_bd:types{ ret = "double", "byte", "double", direct = direct }
+    assert(dll.tf_bd(0, 42) == 14)
+  end
+end
+
+do
+  io.write(".")
+  local f = dll.TwoOutArgs
+  f:types("void", "int", "ref int", "int", "ref int")
+  local r, i, j = f(1, 10, 2, 20)
+  assert(r == nil and i == 11 and j == 22)
+  f:types("void", "int", "ref int", "int", "pointer")
+  local buf = alien.buffer(alien.sizeof("int"))
+  buf:set(1, 5, "int")
+  r, i = f(3, 4, 6, buf)
+  assert(r == nil and i == 7 and buf:get(1, "int") == 11)
+end
+
+do
+  io.write(".")
+  local f = dll._testfunc_callback_i_if
+  f:types("int", "int", "callback")
+  local inner = alien.callback(function (v) return v end, "int", "int")
+  local outer = alien.callback(function (v) return f(v, inner) end, "int", "int")
+  -- every level reenters f while the outer call's frame is in use
+  assert(f(4, outer) == 7 + 3 + 1)
+  assert(f(4, inner) == 7)
+end
+
+do
+  io.write(".")
+  local f = dll._testfunc_callback_i_if
+  f:types("int", "int", "callback")
+  local fail = alien.callback(function (v) error("stop at " .. v) end, "int", "int")
+  local ok, msg = pcall(f, 4, fail)
+  assert(not ok and msg:match("stop at 4$"))
+  -- the error released f, and it still works
+  local outer = alien.callback(function (v) return f(v, fail) end, "int", "int")
+  ok, msg = pcall(f, 8, outer)
+  assert(not ok and msg:match("stop at 8$"))
+  assert(f(4, alien.callback(function (v) return v end, "int", "int")) == 7)
+end
+
 do
   io.write(".")
   local f = dll._testfunc_i_bhilpfdll
@@ -353,6 +403,68 @@ for _, t in ipairs(types) do
   assert(alien["to" .. t](ptr) == 5)
 end
 
+do
+  io.write(".")
+  local buf = alien.buffer(16)
+  local u32, i16, f64 = buf.u32, buf.i16, buf.f64
+  assert(rawequal(buf.u32, u32) and #u32 == 4 and #i16 == 8 and #f64 == 2)
+  u32[1] = 0xfffffffe
+  assert(u32[1] == 0xfffffffe and buf:get(1, "uint") == 0xfffffffe)
+  assert(i16[1] == -2 and i16[2] == -1 and buf.u8[1] == 0xfe and buf.i8[1] == -2)
+  f64[2] = 2.5
+  assert(buf:get(9, "double") == 2.5)
+  buf.ptr[1] = buf:topointer()
+  assert(buf.ptr[1] == buf:topointer())
+  assert(not pcall(function () return u32[5] end))
+  assert(not pcall(function () u32[0] = 1 end))
+  local acc = alien.accessor("ushort")
+  assert(acc:size() == alien.sizeof("ushort"))
+  acc:set(buf, 3, 65535)
+  assert(acc:get(buf, 3) == 65535 and i16[2] == -1)
+  assert(not pcall(acc.get, acc, buf, 16))
+  assert(not pcall(alien.accessor, "string"))
+  assert(type(buf.tostring) == "function")
+end
+
+do
+  io.write(".")
+  local buf = alien.buffer(16)
+  assert(buf:setarray(1, "short", { 1, -2, 3, -4 }) == 4)
+  local t = buf:getarray(1, "short", 4)
+  assert(#t == 4 and t[2] == -2 and t[4] == -4)
+  assert(buf:getarray(3, "ushort", 1)[1] == 65534)
+  local reuse = { 0, 0, 0, 99 }
+  assert(buf:getarray(1, "char", 3, reuse) == reuse)
+  assert(reuse[1] == 1 and reuse[4] == 99)
+  assert(buf:setarray(9, "int", alien.buffer(8):tostring(8)) == 2)
+  assert(buf:setarray(9, "char", "\1\2") == 2 and buf.u8[10] == 2)
+  assert(not pcall(buf.setarray, buf, 1, "int", "abc"))
+  assert(not pcall(buf.getarray, buf, 1, "double", 3))
+  assert(not pcall(buf.setarray, buf, 13, "int", { 1, 2 }))
+  assert(not pcall(buf.getarray, buf, 1, "string", 1))
+  assert(#buf:getarray(17, "int", 0) == 0)
+end
+
+do
+  io.write(".")
+  local size = 4096
+  local buf = alien.buffer(size)
+  buf:setarray(1, "char", string.rep("\255", size))
+  assert(buf:find("\255\0") == nil)
+  buf:setarray(size - 2, "char", "\0\1")
+  assert(buf:find("\255\0") == size - 3)
+  assert(buf:find("\255\255\255\0\1") == size - 5)
+  assert(buf:find("\0\1", 1, size - 3) == nil)
+  assert(buf:find("\0\1", size - 2) == size - 2)
+  assert(buf:find("") == 1 and buf:find("", size + 1) == size + 1)
+  assert(buf:find("\255", size - 1) == size)
+  local wrap = alien.buffer(buf:topointer())
+  assert(wrap:find("\0\1", 1, size) == size - 2)
+  assert(not pcall(wrap.find, wrap, "\0"))
+  assert(not pcall(buf.find, buf, "x", size + 2))
+  assert(not pcall(buf.find, buf, "x", 1, size + 1))
+end
+
 local types = { "float", "double"}
 
 for _, t in ipairs(types) do
@@ -477,6 +589,36 @@ for _, t in ipairs(types) do
    assert(not pcall(function () return arr[5] end))
 end
 
+do
+  io.write(".")
+  local arr = alien.array("int", { 10, 20, 30, 40, 50 })
+  assert(#arr == 5)
+  local n = 0
+  for i, v in ipairs(arr) do
+    assert(v == i * 10)
+    n = n + 1
+  end
+  assert(n == 5)
+  local s = arr:slice(2, 4)
+  assert(#s == 3 and s.type == "int" and s.buffer == arr.buffer)
+  assert(s[1] == 20 and s[3] == 40)
+  s[2] = 33
+  assert(arr[3] == 33)
+  assert(not pcall(function () return s[4] end))
+  assert(not pcall(s.realloc, s, 10))
+  assert(#arr:slice(6) == 0)
+  assert(not pcall(function () arr.length = 2 end))
+  arr.name = "nums"
+  assert(arr.name == "nums")
+  assert(alien.buffer(arr:topointer()):get(1, "int") == 10)
+  local deref = dll._testfunc_deref_pointer
+  deref:types("int", "pointer")
+  assert(deref(arr) == 10)
+  assert(deref(s) == 20)
+  local ptrs = alien.array("pointer", { "a", "bc" })
+  assert(alien.tostring(ptrs[2]) == "bc")
+end
+
 do
   io.write(".")
   local buf = alien.buffer(4)
@@ -570,6 +712,37 @@ do
   --assert(getrect(alien.byval(rect1())) == 10)
 end
 
+do
+  io.write(".")
+  local rect = alien.defstruct{
+    { "left", "short" },
+    { "top", "long" },
+    { "right", "short" },
+  }
+  local along = alien.align("long")
+  assert(rect.offsets.top == along)
+  assert(rect.offsets.right == along + alien.sizeof("long"))
+  assert(rect.align == along)
+  assert(rect.size % along == 0 and rect.size > rect.offsets.right)
+  assert(#rect.names == 3 and rect.names[2] == "top" and rect.types.right == "short")
+  local buf = alien.buffer(rect.size * 2)
+  local r1, r2 = rect:new(buf), rect:new(buf:topointer(rect.size + 1))
+  r1.top, r2.top = 7, 9
+  assert(buf:get(rect.offsets.top + 1, "long") == 7)
+  assert(r1() == buf and r2.top == 9)
+  assert(not pcall(function () return r1.nothing end))
+  assert(not pcall(function () r1.nothing = 1 end))
+  local deref = dll._testfunc_deref_pointer
+  deref:types("int", "pointer")
+  r1.left = 3
+  assert(deref(r1) == buf:get(1, "int"))
+  local small = alien.defstruct{ { "ptr", "pointer" }, { "tag", "char" } }
+  assert(not pcall(function () small:new(alien.buffer(1)).tag = 1 end))
+  local s = small:new()
+  s.ptr = nil
+  assert(s.ptr == nil)
+end
+
 do
   io.write(".")
    local buf = alien.buffer('123456')
@@ -0,0 +1,64 @@
+-- small interpreter benchmark: run the same workloads on two builds
+-- (e.g. with and without LUA_USE_JUMPTABLE) and compare the timings
+-- usage: Bench.lua [scale]
+
+local scale = tonumber(arg and arg[1]) or 1
+
+-- scan a synthetic flash image for a signature, byte by byte
+local function scan (image, n)
+  local byte = string.byte
+  local hits = 0
+  for pass = 1, n do
+    for i = 1, #image - 3 do
+      local a, b, c, d = byte(image, i, i + 3)
+      if a == 0x5F and b == 0x46 and c == 0x56 and d == 0x48 then
+        hits = hits + 1
+      end
+    end
+  end
+  return hits
+end
+
+-- tight arithmetic loop (checksum over a register window)
+local function checksum (n)
+  local sum = 0
+  for i = 1, n do
+    sum = (sum + i * 31) % 65521
+  end
+  return sum
+end
+
+-- table walk with field accesses and method calls
+local function walk (n)
+  local node = nil
+  for i = 1, 1000 do
+    node = {next = node, size = i, kind = i % 7}
+  end
+  local total = 0
+  for pass = 1, n do
+    local p = node
+    while p do
+      if p.kind ~= 0 then total = total + p.size end
+      p = p.next
+    end
+  end
+  return total
+end
+
+local function fib (n)
+  if n < 2 then return n end
+  return fib(n - 1) + fib(n - 2)
+end
+
+local function run (name, f, ...)
+  local t0 = os.clock()
+  local r = f(...)
+  print(string.format("%-10s %8.3f s  (%s)", name, os.clock() - t0, tostring(r)))
+end
+
+local image = string.rep("\255", 4096) .. "_FVH" .. string.rep("\0", 4096)
+
+run("scan", scan, image, 100 * scale)
+run("checksum", checksum, 5000000 * scale)
+run("walk", walk, 2000 * scale)
+run("fib", fib, 27 + scale)
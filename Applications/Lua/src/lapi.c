@@ -303,9 +303,8 @@ LUA_API void lua_arith (lua_State *L, int op) {
   }
   o1 = L->top - 2;
   o2 = L->top - 1;
-  if (ttisnumber(o1) && ttisnumber(o2)) {
-    setnvalue(o1, luaO_arith(op, nvalue(o1), nvalue(o2)));
-  }
+  if (ttisnumber(o1) && ttisnumber(o2))
+    luaO_arithnum(op, o1, o2, o1);
   else
     luaV_arith(L, o1, o1, o2, cast(TMS, op - LUA_OPADD + TM_ADD));
   L->top--;
@@ -351,8 +350,12 @@ LUA_API lua_Integer lua_tointegerx (lua_State *L, int idx, int *isnum) {
   const TValue *o = index2addr(L, idx);
   if (tonumber(o, &n)) {
     lua_Integer res;
-    lua_Number num = nvalue(o);
-    lua_number2integer(res, num);
+    if (ttisinteger(o))
+      res = ivalue(o);
+    else {
+      lua_Number num = fltvalue(o);
+      lua_number2integer(res, num);
+    }
     if (isnum) *isnum = 1;
     return res;
   }
@@ -368,8 +371,12 @@ LUA_API lua_Unsigned lua_tounsignedx (lua_State *L, int idx, int *isnum) {
   const TValue *o = index2addr(L, idx);
   if (tonumber(o, &n)) {
     lua_Unsigned res;
-    lua_Number num = nvalue(o);
-    lua_number2unsigned(res, num);
+    if (ttisinteger(o))
+      res = cast(lua_Unsigned, ivalue(o));  /* modulo conversion */
+    else {
+      lua_Number num = fltvalue(o);
+      lua_number2unsigned(res, num);
+    }
     if (isnum) *isnum = 1;
     return res;
   }
@@ -482,17 +489,21 @@ LUA_API void lua_pushnumber (lua_State *L, lua_Number n) {
 
 LUA_API void lua_pushinteger (lua_State *L, lua_Integer n) {
   lua_lock(L);
-  setnvalue(L->top, cast_num(n));
+  setivalue(L->top, n);
   api_incr_top(L);
   lua_unlock(L);
 }
 
 
 LUA_API void lua_pushunsigned (lua_State *L, lua_Unsigned u) {
-  lua_Number n;
   lua_lock(L);
-  n = lua_unsigned2number(u);
-  setnvalue(L->top, n);
+  if ((u & ~cast(lua_Unsigned, MAX_LUAINTEGER)) == 0) {  /* fits? */
+    setivalue(L->top, cast(lua_Integer, u));
+  }
+  else {
+    lua_Number n = lua_unsigned2number(u);
+    setnvalue(L->top, n);
+  }
   api_incr_top(L);
   lua_unlock(L);
 }
@@ -683,6 +694,35 @@ LUA_API void lua_createtable (lua_State *L, int narray, int nrec) {
 }
 
 
+/*
+** removes all entries of the table at 'idx', keeping its allocated parts
+*/
+LUA_API void lua_cleartable (lua_State *L, int idx) {
+  StkId t;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  luaH_clear(L, hvalue(t));
+  lua_unlock(L);
+}
+
+
+/*
+** sorts t[1..n] of the table at 'idx' in place with the primitive order,
+** if its elements allow it; returns 0 (doing nothing) otherwise
+*/
+LUA_API int lua_sortarray (lua_State *L, int idx, int n, int stable) {
+  StkId t;
+  int res;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  res = luaH_sort(L, hvalue(t), n, stable);
+  lua_unlock(L);
+  return res;
+}
+
+
 LUA_API int lua_getmetatable (lua_State *L, int objindex) {
   const TValue *obj;
   Table *mt = NULL;
@@ -794,6 +834,44 @@ LUA_API void lua_rawseti (lua_State *L, int idx, int n) {
 }
 
 
+/*
+** t2[t..t+e-f] = t1[f..e], with raw accesses. A range that lies in the
+** array parts of both tables is copied with a single memmove.
+*/
+LUA_API void lua_rawmove (lua_State *L, int idx1, int f, int e, int idx2, int t) {
+  Table *t1, *t2;
+  StkId o;
+  lua_lock(L);
+  o = index2addr(L, idx1);
+  api_check(L, ttistable(o), "table expected");
+  t1 = hvalue(o);
+  o = index2addr(L, idx2);
+  api_check(L, ttistable(o), "table expected");
+  t2 = hvalue(o);
+  if (f <= e) {
+    int n = e - f;  /* number of elements minus one */
+    api_check(L, t <= MAX_INT - n, "destination wrap around");
+    if (f >= 1 && e <= t1->sizearray && t >= 1 && t + n <= t2->sizearray) {
+      memmove(&t2->array[t - 1], &t1->array[f - 1], (n + 1) * sizeof(TValue));
+      if (isblack(obj2gco(t2)))  /* may now hold white values */
+        luaC_barrierback_(L, obj2gco(t2));
+    }
+    else {
+      int i;
+      TValue v;
+      int back = (t1 == t2 && t > f && t <= e);  /* overlapping upwards? */
+      for (i = 0; i <= n; i++) {
+        int k = back ? n - i : i;
+        setobj(L, &v, luaH_getint(t1, f + k));
+        luaH_setint(L, t2, t + k, &v);
+        luaC_barrierback(L, obj2gco(t2), &v);
+      }
+    }
+  }
+  lua_unlock(L);
+}
+
+
 LUA_API void lua_rawsetp (lua_State *L, int idx, const void *p) {
   StkId t;
   TValue k;
@@ -1077,6 +1155,15 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
       g->gcstepmul = data;
       break;
     }
+    case LUA_GCSETSTEPTIME: {
+      res = g->gcsteptime;
+      g->gcsteptime = (data > 0) ? data : 0;
+      break;
+    }
+    case LUA_GCIDLE: {
+      res = luaC_idle(L, data);
+      break;
+    }
     case LUA_GCISRUNNING: {
       res = g->gcrunning;
       break;
@@ -1096,6 +1183,68 @@ LUA_API int lua_gc (lua_State *L, int what, int data) {
 }
 
 
+/*
+** copy the collector statistics into '*s' (if not NULL) and, if 'reset',
+** start counting again from zero
+*/
+LUA_API void lua_gcstats (lua_State *L, lua_GCStats *s, int reset) {
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  if (s != NULL) *s = g->gcstats;
+  if (reset) memset(&g->gcstats, 0, sizeof(g->gcstats));
+  lua_unlock(L);
+}
+
+
+
+/*
+** set the maximum number of bytes the state may use (0 means no limit);
+** returns the previous limit
+*/
+LUA_API size_t lua_setmemlimit (lua_State *L, size_t limit) {
+  global_State *g;
+  size_t old;
+  lua_lock(L);
+  g = G(L);
+  old = cast(size_t, g->memlimit);
+  g->memlimit = cast(lu_mem, limit);
+  lua_unlock(L);
+  return old;
+}
+
+
+LUA_API size_t lua_getmemlimit (lua_State *L) {
+  return cast(size_t, G(L)->memlimit);
+}
+
+
+/*
+** largest number of bytes used so far; if 'reset', start tracking again
+** from the current use
+*/
+LUA_API size_t lua_mempeak (lua_State *L, int reset) {
+  global_State *g;
+  size_t peak;
+  lua_lock(L);
+  g = G(L);
+  peak = cast(size_t, g->mempeak);
+  if (reset) g->mempeak = gettotalbytes(g);
+  lua_unlock(L);
+  return peak;
+}
+
+
+LUA_API void lua_setlowmemory (lua_State *L, lua_LowMemory f, void *ud) {
+  global_State *g;
+  lua_lock(L);
+  g = G(L);
+  g->lowmem = f;
+  g->lowmemud = ud;
+  lua_unlock(L);
+}
+
+
 
 /*
 ** miscellaneous functions
@@ -1147,6 +1296,29 @@ LUA_API void lua_concat (lua_State *L, int n) {
 }
 
 
+/*
+** pushes the concatenation of t[i..j] (raw accesses) of the table at
+** 'idx', separated by 'sep'; returns 0 (pushing nothing) if some of
+** these values is neither a string nor a number
+*/
+LUA_API int lua_concattable (lua_State *L, int idx, int i, int j,
+                             const char *sep, size_t lsep) {
+  StkId t;
+  int res = 0;
+  lua_lock(L);
+  t = index2addr(L, idx);
+  api_check(L, ttistable(t), "table expected");
+  api_check(L, i <= j, "empty range");
+  luaC_checkGC(L);
+  if (luaV_concattable(L, hvalue(t), i, j, sep, lsep)) {
+    api_incr_top(L);
+    res = 1;
+  }
+  lua_unlock(L);
+  return res;
+}
+
+
 LUA_API void lua_len (lua_State *L, int idx) {
   StkId t;
   lua_lock(L);
@@ -927,6 +927,205 @@ static void *l_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
 }
 
 
+/*
+** {======================================================
+** Pool allocator: small blocks come from size-class free lists carved
+** out of page-sized chunks; larger blocks go to 'realloc'. Chunks are
+** kept until the state is closed.
+** =======================================================
+*/
+
+/* size of each chunk taken from the system */
+#if !defined(LUAL_POOLCHUNK)
+#define LUAL_POOLCHUNK		4096
+#endif
+
+/* largest block served by the pool */
+#if !defined(LUAL_POOLMAXSMALL)
+#define LUAL_POOLMAXSMALL	256
+#endif
+
+/* granularity of the size classes (a power of 2; keeps blocks aligned) */
+#define POOLALIGN	8
+
+/* number of size classes; blocks up to POOLMAXSMALL bytes use the pool */
+#define POOLCLASSES	(LUAL_POOLMAXSMALL / POOLALIGN)
+#define POOLMAXSMALL	(POOLCLASSES * POOLALIGN)
+
+#define sizeclass(n)	(((n) - 1) / POOLALIGN)
+#define classsize(c)	(((c) + 1) * POOLALIGN)
+
+/* large blocks always have room for a chunk header plus any small block
+   (see 'pool_adopt') */
+#define POOLLARGEMIN	(POOLMAXSMALL + sizeof(PoolChunk))
+#define largesize(n)	((n) < POOLLARGEMIN ? POOLLARGEMIN : (n))
+
+
+/* chunk header; the union keeps the blocks that follow it aligned */
+typedef union PoolChunk {
+  union PoolChunk *next;  /* list of all chunks */
+  double d; void *p; long l;
+} PoolChunk;
+
+
+typedef struct PoolBlock {
+  struct PoolBlock *next;  /* free-list link */
+} PoolBlock;
+
+
+typedef struct Pool {
+  PoolBlock *freeblocks[POOLCLASSES];
+  char *top[POOLCLASSES];  /* unused part of the current chunk of a class */
+  char *limit[POOLCLASSES];
+  PoolChunk *chunks;
+  size_t live;  /* number of live blocks (small and large) */
+  int owned;  /* true while 'luaL_newstatepool' is still creating it */
+  luaL_PoolStats st;
+} Pool;
+
+
+static void pool_release (Pool *pool) {
+  PoolChunk *c = pool->chunks;
+  while (c != NULL) {
+    PoolChunk *next = c->next;
+    free(c);
+    c = next;
+  }
+  free(pool);
+}
+
+
+static void *pool_newblock (Pool *pool, int c) {
+  PoolBlock *b = pool->freeblocks[c];
+  size_t size = classsize(c);
+  if (b != NULL) {  /* reuse a free block */
+    pool->freeblocks[c] = b->next;
+    pool->st.freebytes -= size;
+    return b;
+  }
+  if ((size_t)(pool->limit[c] - pool->top[c]) < size) {  /* chunk full? */
+    PoolChunk *chunk = (PoolChunk *)malloc(LUAL_POOLCHUNK);
+    if (chunk == NULL) return NULL;
+    chunk->next = pool->chunks;
+    pool->chunks = chunk;
+    pool->top[c] = (char *)(chunk + 1);
+    pool->limit[c] = (char *)chunk + LUAL_POOLCHUNK;
+    pool->st.chunks++;
+    pool->st.chunkbytes += LUAL_POOLCHUNK;
+  }
+  b = (PoolBlock *)pool->top[c];
+  pool->top[c] += size;
+  return b;
+}
+
+
+static void pool_freeblock (Pool *pool, void *ptr, int c) {
+  PoolBlock *b = (PoolBlock *)ptr;
+  b->next = pool->freeblocks[c];
+  pool->freeblocks[c] = b;
+  pool->st.freebytes += classsize(c);
+}
+
+
+/*
+** Turn the large block 'ptr' into a chunk holding just the small block
+** of 'nsize' bytes that replaces it. This is how a large block shrinks
+** into the pool when there is no memory for a new chunk, as shrinking
+** must never fail.
+*/
+static void *pool_adopt (Pool *pool, void *ptr, size_t osize, size_t nsize) {
+  PoolChunk *chunk = (PoolChunk *)ptr;
+  void *b = chunk + 1;
+  memmove(b, ptr, nsize);  /* before the header overwrites the data */
+  chunk->next = pool->chunks;
+  pool->chunks = chunk;
+  pool->st.chunks++;
+  pool->st.chunkbytes += largesize(osize);
+  return b;
+}
+
+
+/* account for a block of 'size' bytes entering (+1) or leaving (-1) use */
+static void pool_count (Pool *pool, size_t size, int delta) {
+  if (size <= POOLMAXSMALL) {
+    size_t bsize = classsize(sizeclass(size));
+    if (delta > 0) {
+      pool->st.usedbytes += size; pool->st.blockbytes += bsize;
+    }
+    else {
+      pool->st.usedbytes -= size; pool->st.blockbytes -= bsize;
+    }
+  }
+  else if (delta > 0) pool->st.largebytes += size;
+  else pool->st.largebytes -= size;
+}
+
+
+static void *pool_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  Pool *pool = (Pool *)ud;
+  void *nptr;
+  if (ptr == NULL) osize = 0;  /* 'osize' encodes the object type */
+  if (nsize == 0) {  /* free */
+    if (ptr == NULL) return NULL;
+    pool_count(pool, osize, -1);
+    pool->st.nfrees++;
+    if (osize <= POOLMAXSMALL) pool_freeblock(pool, ptr, sizeclass(osize));
+    else free(ptr);
+    if (--pool->live == 0 && !pool->owned)  /* state fully closed? */
+      pool_release(pool);
+    return NULL;
+  }
+  if (ptr != NULL && osize <= POOLMAXSMALL && nsize <= POOLMAXSMALL &&
+      sizeclass(osize) == sizeclass(nsize))  /* same size class? */
+    nptr = ptr;
+  else if (ptr != NULL && osize > POOLMAXSMALL && nsize > POOLMAXSMALL) {
+    nptr = realloc(ptr, largesize(nsize));  /* large to large */
+    if (nptr == NULL && nsize <= osize)  /* shrinking cannot fail */
+      nptr = ptr;  /* keep the old (larger) block */
+  }
+  else {
+    nptr = (nsize <= POOLMAXSMALL) ? pool_newblock(pool, sizeclass(nsize))
+                                   : malloc(largesize(nsize));
+    if (nptr != NULL) {
+      if (ptr != NULL) {  /* move a block between classes or to 'malloc' */
+        memcpy(nptr, ptr, (osize < nsize) ? osize : nsize);
+        if (osize <= POOLMAXSMALL) pool_freeblock(pool, ptr, sizeclass(osize));
+        else free(ptr);
+      }
+    }
+    else if (ptr == NULL || nsize > osize)
+      return NULL;
+    else if (osize <= POOLMAXSMALL)  /* shrink to a smaller class? */
+      nptr = ptr;  /* keep the old block; it is larger than the new class */
+    else  /* shrink from 'malloc' to the pool */
+      nptr = pool_adopt(pool, ptr, osize, nsize);
+  }
+  if (nptr == NULL) return NULL;
+  if (ptr == NULL) {
+    pool->live++;
+    pool->st.nallocs++;
+  }
+  else pool_count(pool, osize, -1);
+  pool_count(pool, nsize, +1);
+  return nptr;
+}
+
+
+/*
+** Fill 'st' with the pool statistics of state 'L'; returns 0 (and leaves
+** 'st' untouched) when 'L' does not use the pool allocator.
+*/
+LUALIB_API int luaL_poolstats (lua_State *L, luaL_PoolStats *st) {
+  void *ud;
+  if (lua_getallocf(L, &ud) != pool_alloc)
+    return 0;
+  *st = ((Pool *)ud)->st;
+  return 1;
+}
+
+/* }====================================================== */
+
+
 static int panic (lua_State *L) {
   luai_writestringerror("PANIC: unprotected error in call to Lua API (%s)\n",
                    lua_tostring(L, -1));
@@ -941,6 +1140,26 @@ LUALIB_API lua_State *luaL_newstate (void) {
 }
 
 
+/*
+** Same as 'luaL_newstate', but with the pool allocator. The pool is
+** released when 'lua_close' frees the last block of the state.
+*/
+LUALIB_API lua_State *luaL_newstatepool (void) {
+  lua_State *L;
+  Pool *pool = (Pool *)calloc(1, sizeof(Pool));
+  if (pool == NULL) return NULL;
+  pool->owned = 1;  /* a failed 'lua_newstate' frees all its blocks */
+  L = lua_newstate(pool_alloc, pool);
+  if (L == NULL) {
+    pool_release(pool);
+    return NULL;
+  }
+  pool->owned = 0;
+  lua_atpanic(L, &panic);
+  return L;
+}
+
+
 LUALIB_API void luaL_checkversion_ (lua_State *L, lua_Number ver) {
   const lua_Number *v = lua_version(L);
   if (v != lua_version(NULL))
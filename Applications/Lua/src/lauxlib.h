@@ -13,3 +13,29 @@
   WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 **/
 #include <Lua/lauxlib.h>
+
+
+#ifndef lauxlib_pool_h
+#define lauxlib_pool_h
+
+/*
+** Statistics of the pool allocator. Occupancy is 'blockbytes' over
+** 'chunkbytes'; 'blockbytes - usedbytes' is lost to size-class rounding
+** and 'freebytes' sits in the free lists.
+*/
+typedef struct luaL_PoolStats {
+  size_t chunks;      /* number of chunks taken from the system */
+  size_t chunkbytes;  /* bytes held in chunks */
+  size_t blockbytes;  /* bytes in live pool blocks (size-class rounded) */
+  size_t usedbytes;   /* bytes requested for live pool blocks */
+  size_t freebytes;   /* bytes in the free lists */
+  size_t largebytes;  /* bytes in live blocks too large for the pool */
+  size_t nallocs;     /* number of allocations */
+  size_t nfrees;      /* number of frees */
+} luaL_PoolStats;
+
+LUALIB_API lua_State *(luaL_newstatepool) (void);
+LUALIB_API int (luaL_poolstats) (lua_State *L, luaL_PoolStats *st);
+
+
+#endif
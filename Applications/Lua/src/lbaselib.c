@@ -45,11 +45,28 @@ static int luaB_print (lua_State *L) {
 
 #define SPACECHARS  " \f\n\r\t\v"
 
+/* smallest lua_Integer (as MIN_LUAINTEGER in llimits.h) */
+#define MININTEGER  (-(lua_Integer)(~(size_t)0 >> 1) - 1)
+
 static int luaB_tonumber (lua_State *L) {
   if (lua_isnoneornil(L, 2)) {  /* standard conversion */
     int isnum;
-    lua_Number n = lua_tonumberx(L, 1, &isnum);
+    lua_Number n;
+    if (lua_type(L, 1) == LUA_TNUMBER) {  /* already a number? */
+      lua_settop(L, 1);  /* keep its subtype */
+      return 1;
+    }
+    n = lua_tonumberx(L, 1, &isnum);
     if (isnum) {
+      if (n >= (lua_Number)MININTEGER &&  /* in range (and not NaN)? */
+          n < -(lua_Number)MININTEGER) {
+        lua_Integer ni = lua_tointeger(L, 1);  /* exact for integers */
+        if ((lua_Number)ni == n &&  /* integral numeral (but not -0)? */
+            !(n == 0 && 1 / n < 0)) {
+          lua_pushinteger(L, ni);  /* keep it exact */
+          return 1;
+        }
+      }
       lua_pushnumber(L, n);
       return 1;
     }  /* else not a number; must be something */
@@ -157,16 +174,78 @@ static int luaB_rawset (lua_State *L) {
 }
 
 
+/* options of 'collectgarbage' not handled by 'lua_gc' */
+#define GCSTATS		(-1)
+#define GCLIMIT		(-2)
+#define GCPEAK		(-3)
+
+
+static void setstatfield (lua_State *L, const char *k, lua_Number v) {
+  lua_pushnumber(L, v);
+  lua_setfield(L, -2, k);
+}
+
+
+static int gcstats (lua_State *L, int reset) {
+  static const char *const phases[LUA_GCNPHASES] =
+    {"propagate", "atomic", "sweep", "finalize"};
+  lua_GCStats s;
+  int i;
+  lua_gcstats(L, &s, reset);
+  lua_createtable(L, 0, 14);
+  lua_createtable(L, 0, LUA_GCNPHASES);
+  for (i = 0; i < LUA_GCNPHASES; i++)
+    setstatfield(L, phases[i], s.phasetime[i]);
+  lua_setfield(L, -2, "time");
+  lua_createtable(L, LUA_GCNPAUSEBINS, 0);
+  for (i = 0; i < LUA_GCNPAUSEBINS; i++) {
+    lua_pushnumber(L, s.pauses[i]);
+    lua_rawseti(L, -2, i + 1);
+  }
+  lua_setfield(L, -2, "pauses");
+  setstatfield(L, "marked", s.objmarked);
+  setstatfield(L, "markedbytes", s.bytesmarked);
+  setstatfield(L, "swept", s.objswept);
+  setstatfield(L, "sweptbytes", s.bytesswept);
+  setstatfield(L, "finalizers", s.finalizers);
+  setstatfield(L, "steps", s.steps);
+  setstatfield(L, "maxpause", s.maxpause);
+  setstatfield(L, "cycles", s.cycles);
+  setstatfield(L, "gencycles", s.gencycles);
+  setstatfield(L, "fullcycles", s.fullcycles);
+  setstatfield(L, "emergencies", s.emergencies);
+  return 1;
+}
+
+
 static int luaB_collectgarbage (lua_State *L) {
   static const char *const opts[] = {"stop", "restart", "collect",
     "count", "step", "setpause", "setstepmul",
-    "setmajorinc", "isrunning", "generational", "incremental", NULL};
+    "setmajorinc", "isrunning", "generational", "incremental", "stats",
+    "limit", "peak", "setsteptime", "idle", NULL};
   static const int optsnum[] = {LUA_GCSTOP, LUA_GCRESTART, LUA_GCCOLLECT,
     LUA_GCCOUNT, LUA_GCSTEP, LUA_GCSETPAUSE, LUA_GCSETSTEPMUL,
-    LUA_GCSETMAJORINC, LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC};
+    LUA_GCSETMAJORINC, LUA_GCISRUNNING, LUA_GCGEN, LUA_GCINC, GCSTATS,
+    GCLIMIT, GCPEAK, LUA_GCSETSTEPTIME, LUA_GCIDLE};
   int o = optsnum[luaL_checkoption(L, 1, "collect", opts)];
-  int ex = luaL_optint(L, 2, 0);
-  int res = lua_gc(L, o, ex);
+  int ex;
+  int res;
+  if (o == GCSTATS)  /* its argument is a reset flag */
+    return gcstats(L, lua_toboolean(L, 2));
+  ex = luaL_optint(L, 2, 0);
+  switch (o) {
+    case GCLIMIT: {  /* limit in Kbytes; no argument just queries it */
+      size_t old = lua_isnoneornil(L, 2) ? lua_getmemlimit(L)
+                 : lua_setmemlimit(L, (size_t)luaL_checkunsigned(L, 2) * 1024);
+      lua_pushnumber(L, (lua_Number)old / 1024);
+      return 1;
+    }
+    case GCPEAK: {
+      lua_pushnumber(L, (lua_Number)lua_mempeak(L, ex) / 1024);
+      return 1;
+    }
+  }
+  res = lua_gc(L, o, ex);
   switch (o) {
     case LUA_GCCOUNT: {
       int b = lua_gc(L, LUA_GCCOUNTB, 0);
@@ -174,7 +253,7 @@ static int luaB_collectgarbage (lua_State *L) {
       lua_pushinteger(L, b);
       return 2;
     }
-    case LUA_GCSTEP: case LUA_GCISRUNNING: {
+    case LUA_GCSTEP: case LUA_GCISRUNNING: case LUA_GCIDLE: {
       lua_pushboolean(L, res);
       return 1;
     }
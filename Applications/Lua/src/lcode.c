@@ -30,7 +30,8 @@
 
 
 static int isnumeral(expdesc *e) {
-  return (e->k == VKNUM && e->t == NO_JUMP && e->f == NO_JUMP);
+  return ((e->k == VKNUM || e->k == VKINT) &&
+          e->t == NO_JUMP && e->f == NO_JUMP);
 }
 
 
@@ -293,10 +294,10 @@ static int addk (FuncState *fs, TValue *key, TValue *v) {
   TValue *idx = luaH_set(L, fs->h, key);
   Proto *f = fs->f;
   int k, oldsize;
-  if (ttisnumber(idx)) {
-    lua_Number n = nvalue(idx);
-    lua_number2int(k, n);
-    if (luaV_rawequalobj(&f->k[k], v))
+  if (ttisinteger(idx)) {
+    k = cast_int(ivalue(idx));
+    /* integers and floats with equal values are different constants */
+    if (ttype(&f->k[k]) == ttype(v) && luaV_rawequalobj(&f->k[k], v))
       return k;
     /* else may be a collision (e.g., between 0.0 and "\0\0\0\0\0\0\0\0");
        go through and create a new entry for this value */
@@ -306,7 +307,7 @@ static int addk (FuncState *fs, TValue *key, TValue *v) {
   k = fs->nk;
   /* numerical value does not need GC barrier;
      table has no metatable, so it does not need to invalidate cache */
-  setnvalue(idx, cast_num(k));
+  setivalue(idx, k);
   luaM_growvector(L, f->k, k, f->sizek, TValue, MAXARG_Ax, "constants");
   while (oldsize < f->sizek) setnilvalue(&f->k[oldsize++]);
   setobj(L, &f->k[k], v);
@@ -340,6 +341,18 @@ int luaK_numberK (FuncState *fs, lua_Number r) {
 }
 
 
+/*
+** integer constants use a light userdata as key, as a numeric key would
+** clash with floats of the same value
+*/
+int luaK_intK (FuncState *fs, lua_Integer n) {
+  TValue k, o;
+  setpvalue(&k, cast(void *, cast(size_t, n)));
+  setivalue(&o, n);
+  return addk(fs, &k, &o);
+}
+
+
 static int boolK (FuncState *fs, int b) {
   TValue o;
   setbvalue(&o, b);
@@ -437,6 +450,10 @@ static void discharge2reg (FuncState *fs, expdesc *e, int reg) {
       luaK_codek(fs, reg, luaK_numberK(fs, e->u.nval));
       break;
     }
+    case VKINT: {
+      luaK_codek(fs, reg, luaK_intK(fs, e->u.ival));
+      break;
+    }
     case VRELOCABLE: {
       Instruction *pc = &getcode(fs, e);
       SETARG_A(*pc, reg);
@@ -538,8 +555,9 @@ int luaK_exp2RK (FuncState *fs, expdesc *e) {
       }
       else break;
     }
-    case VKNUM: {
-      e->u.info = luaK_numberK(fs, e->u.nval);
+    case VKNUM: case VKINT: {
+      e->u.info = (e->k == VKINT) ? luaK_intK(fs, e->u.ival)
+                                  : luaK_numberK(fs, e->u.nval);
       e->k = VK;
       /* go through */
     }
@@ -627,7 +645,7 @@ void luaK_goiftrue (FuncState *fs, expdesc *e) {
       pc = e->u.info;
       break;
     }
-    case VK: case VKNUM: case VTRUE: {
+    case VK: case VKNUM: case VKINT: case VTRUE: {
       pc = NO_JUMP;  /* always true; do nothing */
       break;
     }
@@ -672,7 +690,7 @@ static void codenot (FuncState *fs, expdesc *e) {
       e->k = VTRUE;
       break;
     }
-    case VK: case VKNUM: case VTRUE: {
+    case VK: case VKNUM: case VKINT: case VTRUE: {
       e->k = VFALSE;
       break;
     }
@@ -710,13 +728,33 @@ void luaK_indexed (FuncState *fs, expdesc *t, expdesc *k) {
 }
 
 
+/* value of a numeral expression as a TValue */
+static void numeral2tv (expdesc *e, TValue *v) {
+  if (e->k == VKINT) {
+    setivalue(v, e->u.ival);
+  }
+  else {
+    setnvalue(v, e->u.nval);
+  }
+}
+
+
 static int constfolding (OpCode op, expdesc *e1, expdesc *e2) {
-  lua_Number r;
+  TValue v1, v2, r;
   if (!isnumeral(e1) || !isnumeral(e2)) return 0;
-  if ((op == OP_DIV || op == OP_MOD) && e2->u.nval == 0)
+  numeral2tv(e1, &v1);
+  numeral2tv(e2, &v2);
+  if ((op == OP_DIV || op == OP_MOD) && nvalue(&v2) == 0)
     return 0;  /* do not attempt to divide by 0 */
-  r = luaO_arith(op - OP_ADD + LUA_OPADD, e1->u.nval, e2->u.nval);
-  e1->u.nval = r;
+  luaO_arithnum(op - OP_ADD + LUA_OPADD, &v1, &v2, &r);
+  if (ttisinteger(&r)) {
+    e1->k = VKINT;
+    e1->u.ival = ivalue(&r);
+  }
+  else {
+    e1->k = VKNUM;
+    e1->u.nval = fltvalue(&r);
+  }
   return 1;
 }
 
@@ -761,11 +799,11 @@ static void codecomp (FuncState *fs, OpCode op, int cond, expdesc *e1,
 
 void luaK_prefix (FuncState *fs, UnOpr op, expdesc *e, int line) {
   expdesc e2;
-  e2.t = e2.f = NO_JUMP; e2.k = VKNUM; e2.u.nval = 0;
+  e2.t = e2.f = NO_JUMP; e2.k = VKINT; e2.u.ival = 0;
   switch (op) {
     case OPR_MINUS: {
       if (isnumeral(e))  /* minus constant? */
-        e->u.nval = luai_numunm(NULL, e->u.nval);  /* fold it */
+        constfolding(OP_UNM, e, &e2);  /* fold it */
       else {
         luaK_exp2anyreg(fs, e);
         codearith(fs, OP_UNM, e, &e2, line);
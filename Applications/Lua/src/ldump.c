@@ -52,6 +52,11 @@ static void DumpNumber(lua_Number x, DumpState* D)
  DumpVar(x,D);
 }
 
+static void DumpInteger(lua_Integer x, DumpState* D)
+{
+ DumpVar(x,D);
+}
+
 static void DumpVector(const void* b, int n, size_t size, DumpState* D)
 {
  DumpInt(n,D);
@@ -84,8 +89,9 @@ static void DumpConstants(const Proto* f, DumpState* D)
  for (i=0; i<n; i++)
  {
   const TValue* o=&f->k[i];
-  DumpChar(ttypenv(o),D);
-  switch (ttypenv(o))
+  int t=ttisinteger(o) ? LUA_TNUMINT : ttypenv(o);
+  DumpChar(t,D);
+  switch (t)
   {
    case LUA_TNIL:
 	break;
@@ -95,6 +101,9 @@ static void DumpConstants(const Proto* f, DumpState* D)
    case LUA_TNUMBER:
 	DumpNumber(nvalue(o),D);
 	break;
+   case LUA_TNUMINT:
+	DumpInteger(ivalue(o),D);
+	break;
    case LUA_TSTRING:
 	DumpString(rawtsvalue(o),D);
 	break;
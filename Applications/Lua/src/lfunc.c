@@ -16,6 +16,7 @@
 #include "lgc.h"
 #include "lmem.h"
 #include "lobject.h"
+#include "lopcodes.h"
 #include "lstate.h"
 
 
@@ -116,6 +117,8 @@ Proto *luaF_newproto (lua_State *L) {
   f->code = NULL;
   f->cache = NULL;
   f->sizecode = 0;
+  f->icache = NULL;
+  f->sizeicache = 0;
   f->lineinfo = NULL;
   f->sizelineinfo = 0;
   f->upvalues = NULL;
@@ -134,6 +137,7 @@ Proto *luaF_newproto (lua_State *L) {
 
 void luaF_freeproto (lua_State *L, Proto *f) {
   luaM_freearray(L, f->code, f->sizecode);
+  luaM_freearray(L, f->icache, f->sizeicache);
   luaM_freearray(L, f->p, f->sizep);
   luaM_freearray(L, f->k, f->sizek);
   luaM_freearray(L, f->lineinfo, f->sizelineinfo);
@@ -143,6 +147,40 @@ void luaF_freeproto (lua_State *L, Proto *f) {
 }
 
 
+/*
+** Check whether instruction 'i' indexes a table with a constant short
+** string (global names, fields and method names)
+*/
+static int cacheable (const Proto *f, Instruction i) {
+  switch (GET_OPCODE(i)) {
+    case OP_GETTABUP: case OP_GETTABLE: case OP_SELF:
+      return ISK(GETARG_C(i)) && ttisshrstring(&f->k[INDEXK(GETARG_C(i))]);
+    default:
+      return 0;
+  }
+}
+
+
+/*
+** Create the inline caches of a finished prototype; functions without
+** cacheable instructions get none
+*/
+void luaF_initicache (lua_State *L, Proto *f) {
+  int pc;
+  for (pc = 0; pc < f->sizecode; pc++) {
+    if (cacheable(f, f->code[pc])) {
+      f->icache = luaM_newvector(L, f->sizecode, ICache);
+      f->sizeicache = f->sizecode;
+      for (pc = 0; pc < f->sizeicache; pc++) {
+        f->icache[pc].node = NULL;
+        f->icache[pc].slot = 0;
+      }
+      return;
+    }
+  }
+}
+
+
 /*
 ** Look for n-th local variable at line `line' in function `func'.
 ** Returns NULL if not found.
@@ -51,6 +51,28 @@
 #define PAUSEADJ        100
 
 
+/*
+** clock for the collector statistics (see 'lua_gcstats') and for
+** time-sliced steps, in nanoseconds; it is read a few times in each
+** step, so it must be cheap ('clock' is a system call on POSIX
+** systems). Ports with a better tick source (e.g. the TSC or an EFI
+** timer) can define 'luai_gcclock' to read it.
+*/
+#if !defined(luai_gcclock)
+#include <time.h>
+#if defined(LUA_USE_POSIX) && defined(CLOCK_MONOTONIC)
+static lua_Number posixclock (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (lua_Number)ts.tv_sec * 1e9 + (lua_Number)ts.tv_nsec;
+}
+#define luai_gcclock()	posixclock()
+#else
+#define luai_gcclock()	((lua_Number)clock() * (1e9 / CLOCKS_PER_SEC))
+#endif
+#endif
+
+
 /*
 ** 'makewhite' erases all color bits plus the old bit and then
 ** sets only the current white bit
@@ -79,6 +101,7 @@
         reallymarkobject(g, obj2gco(t)); }
 
 static void reallymarkobject (global_State *g, GCObject *o);
+static void keymarked (global_State *g, GCObject *o);
 
 
 /*
@@ -94,6 +117,25 @@ static void reallymarkobject (global_State *g, GCObject *o);
 #define gnodelast(h)    gnode(h, cast(size_t, sizenode(h)))
 
 
+/*
+** node vectors of a table, for the loops below: 'v' 0 is its hash part
+** and 'v' 1 the part still being migrated by an incremental rehash, if any
+*/
+static int nodevector (Table *h, int v, Node **first, Node **limit) {
+  if (v == 0) {
+    *first = gnode(h, 0);
+    *limit = gnodelast(h);
+    return 1;
+  }
+  else if (v == 1 && h->oldnode != NULL) {
+    *first = h->oldnode;
+    *limit = h->oldnode + sizeoldnode(h);
+    return 1;
+  }
+  return 0;
+}
+
+
 /*
 ** link table 'h' into list pointed by 'p'
 */
@@ -243,6 +285,9 @@ GCObject *luaC_newobj (lua_State *L, int tt, size_t sz, GCObject **list,
 static void reallymarkobject (global_State *g, GCObject *o) {
   lu_mem size;
   white2gray(o);
+  g->gcstats.objmarked++;
+  if (g->ephdeps != NULL)  /* converging ephemerons? */
+    keymarked(g, o);  /* entries waiting for 'o' can be marked now */
   switch (gch(o)->tt) {
     case LUA_TSHRSTR:
     case LUA_TLNGSTR: {
@@ -353,19 +398,22 @@ static void restartcollection (global_State *g) {
 */
 
 static void traverseweakvalue (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
+  Node *n, *limit;
+  int v;
   /* if there is array part, assume it may have white values (do not
      traverse it just to check) */
   int hasclears = (h->sizearray > 0);
-  for (n = gnode(h, 0); n < limit; n++) {
-    checkdeadkey(n);
-    if (ttisnil(gval(n)))  /* entry is empty? */
-      removeentry(n);  /* remove it */
-    else {
-      lua_assert(!ttisnil(gkey(n)));
-      markvalue(g, gkey(n));  /* mark key */
-      if (!hasclears && iscleared(g, gval(n)))  /* is there a white value? */
-        hasclears = 1;  /* table will have to be cleared */
+  for (v = 0; nodevector(h, v, &n, &limit); v++) {
+    for (; n < limit; n++) {
+      checkdeadkey(n);
+      if (ttisnil(gval(n)))  /* entry is empty? */
+        removeentry(n);  /* remove it */
+      else {
+        lua_assert(!ttisnil(gkey(n)));
+        markvalue(g, gkey(n));  /* mark key */
+        if (!hasclears && iscleared(g, gval(n)))  /* is there a white value? */
+          hasclears = 1;  /* table will have to be cleared */
+      }
     }
   }
   if (hasclears)
@@ -375,12 +423,134 @@ static void traverseweakvalue (global_State *g, Table *h) {
 }
 
 
+/*
+** {======================================================
+** Pending ephemeron entries
+** =======================================================
+*/
+
+/*
+** While ephemerons converge, every entry "white key -> white value" is
+** recorded here, chained by key in a small hash table.  When its key is
+** marked, the entry moves to the 'ready' chain and its value is marked
+** by 'propagatedeps'; so the tables are traversed once instead of until
+** nothing changes, which is quadratic for chains of entries whose keys
+** are reachable only through other entries.  The arrays are temporary
+** and are not counted as Lua memory; if they cannot grow, 'failed' is
+** set and 'convergeephemerons' falls back to repeating its passes.
+*/
+typedef struct EphDep {
+  GCObject *key;  /* NULL once the entry is ready */
+  GCObject *value;
+  int next;  /* next entry in its bucket or in the 'ready' chain */
+} EphDep;
+
+typedef struct EphDeps {
+  EphDep *dep;
+  int *head;  /* bucket heads (sizehead is a power of 2) */
+  int ndep, sizedep, sizehead;
+  int ready;  /* chain of entries whose key has been marked */
+  int failed;  /* true if some entry could not be recorded */
+} EphDeps;
+
+#define MINEPHDEPS	64
+
+#define depbucket(d,o) \
+	cast_int((IntPoint(o) ^ (IntPoint(o) >> 9)) & ((d)->sizehead - 1))
+
+
+static void *rawrealloc (global_State *g, void *block, size_t osize,
+                                                       size_t nsize) {
+  return (*g->frealloc)(g->ud, block, osize, nsize);
+}
+
+
+static void rehashdeps (EphDeps *d) {
+  int i;
+  for (i = 0; i < d->sizehead; i++) d->head[i] = -1;
+  for (i = 0; i < d->ndep; i++) {
+    EphDep *e = &d->dep[i];
+    if (e->key != NULL) {  /* still pending? */
+      int b = depbucket(d, e->key);
+      e->next = d->head[b];
+      d->head[b] = i;
+    }
+  }
+}
+
+
+static int growdeps (global_State *g, EphDeps *d) {
+  int n = (d->sizedep == 0) ? MINEPHDEPS : 2 * d->sizedep;
+  EphDep *dep;
+  int *head;
+  if (n > MAX_INT / 2) return 0;
+  head = cast(int *, rawrealloc(g, NULL, 0, n * sizeof(int)));
+  if (head == NULL) return 0;
+  dep = cast(EphDep *, rawrealloc(g, d->dep, d->sizedep * sizeof(EphDep),
+                                              n * sizeof(EphDep)));
+  if (dep == NULL) {
+    rawrealloc(g, head, n * sizeof(int), 0);
+    return 0;
+  }
+  rawrealloc(g, d->head, d->sizehead * sizeof(int), 0);
+  d->dep = dep; d->sizedep = n;
+  d->head = head; d->sizehead = n;
+  rehashdeps(d);
+  return 1;
+}
+
+
+static void adddep (global_State *g, GCObject *k, GCObject *v) {
+  EphDeps *d = g->ephdeps;
+  int b;
+  if (d->ndep == d->sizedep && !growdeps(g, d)) {
+    d->failed = 1;  /* 'convergeephemerons' must repeat its passes */
+    return;
+  }
+  b = depbucket(d, k);
+  d->dep[d->ndep].key = k;
+  d->dep[d->ndep].value = v;
+  d->dep[d->ndep].next = d->head[b];
+  d->head[b] = d->ndep++;
+}
+
+
+/*
+** move entries with key 'o' (just marked) to the 'ready' chain
+*/
+static void keymarked (global_State *g, GCObject *o) {
+  EphDeps *d = g->ephdeps;
+  int *p;
+  if (d->ndep == 0) return;
+  p = &d->head[depbucket(d, o)];
+  while (*p >= 0) {
+    EphDep *e = &d->dep[*p];
+    if (e->key == o) {
+      int i = *p;
+      *p = e->next;  /* unlink it */
+      e->key = NULL;
+      e->next = d->ready;
+      d->ready = i;
+    }
+    else p = &e->next;
+  }
+}
+
+
+static void freedeps (global_State *g, EphDeps *d) {
+  rawrealloc(g, d->dep, d->sizedep * sizeof(EphDep), 0);
+  rawrealloc(g, d->head, d->sizehead * sizeof(int), 0);
+}
+
+/* }====================================================== */
+
+
 static int traverseephemeron (global_State *g, Table *h) {
   int marked = 0;  /* true if an object is marked in this traversal */
   int hasclears = 0;  /* true if table has white keys */
   int prop = 0;  /* true if table has entry "white-key -> white-value" */
-  Node *n, *limit = gnodelast(h);
-  int i;
+  Node *n, *limit;
+  int i, v;
   /* traverse array part (numeric keys are 'strong') */
   for (i = 0; i < h->sizearray; i++) {
     if (valiswhite(&h->array[i])) {
@@ -389,18 +559,23 @@ static int traverseephemeron (global_State *g, Table *h) {
     }
   }
   /* traverse hash part */
-  for (n = gnode(h, 0); n < limit; n++) {
-    checkdeadkey(n);
-    if (ttisnil(gval(n)))  /* entry is empty? */
-      removeentry(n);  /* remove it */
-    else if (iscleared(g, gkey(n))) {  /* key is not marked (yet)? */
-      hasclears = 1;  /* table must be cleared */
-      if (valiswhite(gval(n)))  /* value not marked yet? */
-        prop = 1;  /* must propagate again */
-    }
-    else if (valiswhite(gval(n))) {  /* value not marked yet? */
-      marked = 1;
-      reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+  for (v = 0; nodevector(h, v, &n, &limit); v++) {
+    for (; n < limit; n++) {
+      checkdeadkey(n);
+      if (ttisnil(gval(n)))  /* entry is empty? */
+        removeentry(n);  /* remove it */
+      else if (iscleared(g, gkey(n))) {  /* key is not marked (yet)? */
+        hasclears = 1;  /* table must be cleared */
+        if (valiswhite(gval(n))) {  /* value not marked yet? */
+          prop = 1;  /* must propagate again */
+          if (g->ephdeps != NULL)  /* converging? */
+            adddep(g, gcvalue(gkey(n)), gcvalue(gval(n)));
+        }
+      }
+      else if (valiswhite(gval(n))) {  /* value not marked yet? */
+        marked = 1;
+        reallymarkobject(g, gcvalue(gval(n)));  /* mark it now */
+      }
     }
   }
   if (prop)
@@ -414,18 +589,20 @@ static int traverseephemeron (global_State *g, Table *h) {
 
 
 static void traversestrongtable (global_State *g, Table *h) {
-  Node *n, *limit = gnodelast(h);
-  int i;
+  Node *n, *limit;
+  int i, v;
   for (i = 0; i < h->sizearray; i++)  /* traverse array part */
     markvalue(g, &h->array[i]);
-  for (n = gnode(h, 0); n < limit; n++) {  /* traverse hash part */
-    checkdeadkey(n);
-    if (ttisnil(gval(n)))  /* entry is empty? */
-      removeentry(n);  /* remove it */
-    else {
-      lua_assert(!ttisnil(gkey(n)));
-      markvalue(g, gkey(n));  /* mark key */
-      markvalue(g, gval(n));  /* mark value */
+  for (v = 0; nodevector(h, v, &n, &limit); v++) {
+    for (; n < limit; n++) {  /* traverse hash part */
+      checkdeadkey(n);
+      if (ttisnil(gval(n)))  /* entry is empty? */
+        removeentry(n);  /* remove it */
+      else {
+        lua_assert(!ttisnil(gkey(n)));
+        markvalue(g, gkey(n));  /* mark key */
+        markvalue(g, gval(n));  /* mark value */
+      }
     }
   }
 }
@@ -450,7 +627,8 @@ static lu_mem traversetable (global_State *g, Table *h) {
   else  /* not weak */
     traversestrongtable(g, h);
   return sizeof(Table) + sizeof(TValue) * h->sizearray +
-                         sizeof(Node) * cast(size_t, sizenode(h));
+                         sizeof(Node) * cast(size_t, sizenode(h)) +
+                         (h->oldnode ? sizeof(Node) * cast(size_t, sizeoldnode(h)) : 0);
 }
 
 
@@ -468,6 +646,7 @@ static int traverseproto (global_State *g, Proto *f) {
   for (i = 0; i < f->sizelocvars; i++)  /* mark local-variable names */
     markobject(g, f->locvars[i].varname);
   return sizeof(Proto) + sizeof(Instruction) * f->sizecode +
+                         sizeof(ICache) * f->sizeicache +
                          sizeof(Proto *) * f->sizep +
                          sizeof(TValue) * f->sizek +
                          sizeof(int) * f->sizelineinfo +
@@ -591,8 +770,35 @@ static void retraversegrays (global_State *g) {
 }
 
 
+/*
+** propagate marks, including values of entries whose keys got marked;
+** returns true if any such value was marked
+*/
+static int propagatedeps (global_State *g) {
+  EphDeps *d = g->ephdeps;
+  int marked = 0;
+  propagateall(g);
+  while (d->ready >= 0) {
+    GCObject *v = d->dep[d->ready].value;
+    d->ready = d->dep[d->ready].next;
+    if (iswhite(v)) {
+      marked = 1;
+      reallymarkobject(g, v);
+      propagateall(g);
+    }
+  }
+  return marked;
+}
+
+
 static void convergeephemerons (global_State *g) {
+  EphDeps d;
   int changed;
+  d.dep = NULL; d.head = NULL;
+  d.ndep = d.sizedep = d.sizehead = 0;
+  d.ready = -1;
+  d.failed = !growdeps(g, &d);
+  g->ephdeps = &d;
   do {
     GCObject *w;
     GCObject *next = g->ephemeron;  /* get ephemeron list */
@@ -600,12 +806,15 @@ static void convergeephemerons (global_State *g) {
     changed = 0;
     while ((w = next) != NULL) {
       next = gco2t(w)->gclist;
-      if (traverseephemeron(g, gco2t(w))) {  /* traverse marked some value? */
-        propagateall(g);  /* propagate changes */
-        changed = 1;  /* will have to revisit all ephemeron tables */
-      }
+      if (traverseephemeron(g, gco2t(w)))  /* traverse marked some value? */
+        changed = 1;
+      if (propagatedeps(g))  /* propagate changes */
+        changed = 1;
     }
-  } while (changed);
+    /* with all entries recorded, one pass is enough */
+  } while (changed && d.failed);
+  g->ephdeps = NULL;
+  freedeps(g, &d);
 }
 
 /* }====================================================== */
@@ -625,11 +834,14 @@ static void convergeephemerons (global_State *g) {
 static void clearkeys (global_State *g, GCObject *l, GCObject *f) {
   for (; l != f; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *n, *limit = gnodelast(h);
-    for (n = gnode(h, 0); n < limit; n++) {
-      if (!ttisnil(gval(n)) && (iscleared(g, gkey(n)))) {
-        setnilvalue(gval(n));  /* remove value ... */
-        removeentry(n);  /* and remove entry from table */
+    Node *n, *limit;
+    int v;
+    for (v = 0; nodevector(h, v, &n, &limit); v++) {
+      for (; n < limit; n++) {
+        if (!ttisnil(gval(n)) && (iscleared(g, gkey(n)))) {
+          setnilvalue(gval(n));  /* remove value ... */
+          removeentry(n);  /* and remove entry from table */
+        }
       }
     }
   }
@@ -643,17 +855,19 @@ static void clearkeys (global_State *g, GCObject *l, GCObject *f) {
 static void clearvalues (global_State *g, GCObject *l, GCObject *f) {
   for (; l != f; l = gco2t(l)->gclist) {
     Table *h = gco2t(l);
-    Node *n, *limit = gnodelast(h);
-    int i;
+    Node *n, *limit;
+    int i, v;
     for (i = 0; i < h->sizearray; i++) {
       TValue *o = &h->array[i];
       if (iscleared(g, o))  /* value was collected? */
         setnilvalue(o);  /* remove value */
     }
-    for (n = gnode(h, 0); n < limit; n++) {
-      if (!ttisnil(gval(n)) && iscleared(g, gval(n))) {
-        setnilvalue(gval(n));  /* remove value ... */
-        removeentry(n);  /* and remove entry from table */
+    for (v = 0; nodevector(h, v, &n, &limit); v++) {
+      for (; n < limit; n++) {
+        if (!ttisnil(gval(n)) && iscleared(g, gval(n))) {
+          setnilvalue(gval(n));  /* remove value ... */
+          removeentry(n);  /* and remove entry from table */
+        }
       }
     }
   }
@@ -661,6 +875,8 @@ static void clearvalues (global_State *g, GCObject *l, GCObject *f) {
 
 
 static void freeobj (lua_State *L, GCObject *o) {
+  global_State *g = G(L);
+  lu_mem before = gettotalbytes(g);
   switch (gch(o)->tt) {
     case LUA_TPROTO: luaF_freeproto(L, gco2p(o)); break;
     case LUA_TLCL: {
@@ -676,7 +892,7 @@ static void freeobj (lua_State *L, GCObject *o) {
     case LUA_TTHREAD: luaE_freethread(L, gco2th(o)); break;
     case LUA_TUSERDATA: luaM_freemem(L, o, sizeudata(gco2u(o))); break;
     case LUA_TSHRSTR:
-      G(L)->strt.nuse--;
+      g->strt.nuse--;
       /* go through */
     case LUA_TLNGSTR: {
       luaM_freemem(L, o, sizestring(gco2ts(o)));
@@ -684,6 +900,8 @@ static void freeobj (lua_State *L, GCObject *o) {
     }
     default: lua_assert(0);
   }
+  g->gcstats.objswept++;
+  g->gcstats.bytesswept += cast_num(before - gettotalbytes(g));
 }
 
 
@@ -816,6 +1034,7 @@ static void GCTM (lua_State *L, int propagateerrors) {
     int status;
     lu_byte oldah = L->allowhook;
     int running  = g->gcrunning;
+    g->gcstats.finalizers++;
     L->allowhook = 0;  /* stop debug hooks during GC metamethod */
     g->gcrunning = 0;  /* avoid GC steps */
     setobj2s(L, L->top, tm);  /* push finalizer... */
@@ -899,6 +1118,57 @@ void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt) {
 /* }====================================================== */
 
 
+/*
+** {======================================================
+** Statistics
+** =======================================================
+*/
+
+/* phase charged for work done in the current state */
+#define gcphase(g)  \
+	((issweepphase(g) || (g)->gcstate == GCSpause) ? LUA_GCPSWEEP \
+                                                      : LUA_GCPPROPAGATE)
+
+
+/*
+** start timing collector work; returns the current time
+*/
+static lua_Number startclock (global_State *g) {
+  g->gcclock = luai_gcclock();
+  return g->gcclock;
+}
+
+
+/*
+** charge the time elapsed since the last accounting to 'phase'
+*/
+static void chargetime (global_State *g, int phase) {
+  lua_Number now = luai_gcclock();
+  g->gcstats.phasetime[phase] += now - g->gcclock;
+  g->gcclock = now;
+}
+
+
+/*
+** count a step that started at 'start' and ended at the last accounting
+*/
+static void countstep (global_State *g, lua_Number start) {
+  lua_GCStats *s = &g->gcstats;
+  lua_Number t = g->gcclock - start;
+  lua_Number lim = 1000;  /* 1us */
+  int i = 0;
+  while (i < LUA_GCNPAUSEBINS - 1 && t >= lim) {
+    i++;
+    lim *= 2;
+  }
+  s->pauses[i]++;
+  s->steps++;
+  if (t > s->maxpause) s->maxpause = t;
+}
+
+/* }====================================================== */
+
+
 /*
 ** {======================================================
 ** GC control
@@ -912,10 +1182,17 @@ void luaC_checkfinalizer (lua_State *L, GCObject *o, Table *mt) {
 */
 static void setpause (global_State *g, l_mem estimate) {
   l_mem debt, threshold;
+  lu_mem live = cast(lu_mem, estimate);
   estimate = estimate / PAUSEADJ;  /* adjust 'estimate' */
   threshold = (g->gcpause < MAX_LMEM / estimate)  /* overflow? */
             ? estimate * g->gcpause  /* no overflow */
             : MAX_LMEM;  /* overflow; truncate to maximum */
+  if (g->memlimit > live) {
+    /* start next cycle at most halfway to the memory limit, so that it
+       can finish before allocations reach the limit */
+    l_mem half = cast(l_mem, live + (g->memlimit - live) / 2);
+    if (threshold > half) threshold = half;
+  }
   debt = -cast(l_mem, threshold - gettotalbytes(g));
   luaE_setdebt(g, debt);
 }
@@ -1057,11 +1334,14 @@ static lu_mem singlestep (lua_State *L) {
       else {  /* no more `gray' objects */
         lu_mem work;
         int sw;
+        chargetime(g, LUA_GCPPROPAGATE);
         g->gcstate = GCSatomic;  /* finish mark phase */
         g->GCestimate = g->GCmemtrav;  /* save what was counted */;
         work = atomic(L);  /* add what was traversed by 'atomic' */
         g->GCestimate += work;  /* estimate of total memory traversed */
+        g->gcstats.bytesmarked += cast_num(g->GCestimate);
         sw = entersweep(L);
+        chargetime(g, LUA_GCPATOMIC);
         return work + sw * GCSWEEPCOST;
       }
     }
@@ -1095,6 +1375,7 @@ static lu_mem singlestep (lua_State *L) {
         sweeplist(L, &mt, 1);
         checkSizes(L);
         g->gcstate = GCSpause;  /* finish collection */
+        g->gcstats.cycles++;
         return GCSWEEPCOST;
       }
     }
@@ -1109,8 +1390,10 @@ static lu_mem singlestep (lua_State *L) {
 */
 void luaC_runtilstate (lua_State *L, int statesmask) {
   global_State *g = G(L);
+  startclock(g);
   while (!testbit(statesmask, g->gcstate))
     singlestep(L);
+  chargetime(g, gcphase(g));
 }
 
 
@@ -1125,6 +1408,7 @@ static void generationalcollection (lua_State *L) {
     lu_mem estimate = g->GCestimate;
     luaC_runtilstate(L, bitmask(GCSpause));  /* run complete (minor) cycle */
     g->gcstate = GCSpropagate;  /* skip restart */
+    g->gcstats.gencycles++;
     if (gettotalbytes(g) > (estimate / 100) * g->gcmajorinc)
       g->GCestimate = 0;  /* signal for a major collection */
     else
@@ -1136,7 +1420,13 @@ static void generationalcollection (lua_State *L) {
 }
 
 
-static void incstep (lua_State *L) {
+/*
+** incremental step; with a time budget ('gcsteptime'), works until
+** 'deadline' instead of until the debt is paid. Work done beyond the
+** debt becomes credit, so the collector keeps pace with the allocator
+** either way; unpaid debt makes the next step come sooner.
+*/
+static void incstep (lua_State *L, lua_Number deadline) {
   global_State *g = G(L);
   l_mem debt = g->GCdebt;
   int stepmul = g->gcstepmul;
@@ -1144,10 +1434,17 @@ static void incstep (lua_State *L) {
   /* convert debt from Kb to 'work units' (avoid zero debt and overflows) */
   debt = (debt / STEPMULADJ) + 1;
   debt = (debt < MAX_LMEM / stepmul) ? debt * stepmul : MAX_LMEM;
-  do {  /* always perform at least one single step */
-    lu_mem work = singlestep(L);  /* do some work */
-    debt -= work;
-  } while (debt > -GCSTEPSIZE && g->gcstate != GCSpause);
+  if (g->gcsteptime > 0) {
+    do {  /* always perform at least one single step */
+      debt -= singlestep(L);
+    } while (g->gcstate != GCSpause && luai_gcclock() < deadline);
+  }
+  else {
+    do {  /* always perform at least one single step */
+      lu_mem work = singlestep(L);  /* do some work */
+      debt -= work;
+    } while (debt > -GCSTEPSIZE && g->gcstate != GCSpause);
+  }
   if (g->gcstate == GCSpause)
     setpause(g, g->GCestimate);  /* pause until next cycle */
   else {
@@ -1162,12 +1459,58 @@ static void incstep (lua_State *L) {
 */
 void luaC_forcestep (lua_State *L) {
   global_State *g = G(L);
+  lua_Number start = startclock(g);
+  lua_Number deadline = start + (lua_Number)g->gcsteptime * 1000;
   int i;
   if (isgenerational(g)) generationalcollection(L);
-  else incstep(L);
+  else incstep(L, deadline);
+  chargetime(g, gcphase(g));
   /* run a few finalizers (or all of them at the end of a collect cycle) */
-  for (i = 0; g->tobefnz && (i < GCFINALIZENUM || g->gcstate == GCSpause); i++)
+  for (i = 0; g->tobefnz && (i < GCFINALIZENUM || g->gcstate == GCSpause); i++) {
+    if (g->gcsteptime > 0 && i > 0 && luai_gcclock() >= deadline)
+      break;  /* out of time; leave the rest for the next steps */
     GCTM(L, 1);  /* call one finalizer */
+  }
+  if (i > 0) chargetime(g, LUA_GCPFINALIZE);
+  countstep(g, start);
+}
+
+
+/*
+** spends up to 'usec' microseconds on collector work, running pending
+** finalizers with the time left; the work counts as credit against
+** future steps. In generational mode, where cycles are not incremental,
+** performs one basic step. Returns 1 if it finished a cycle.
+*/
+int luaC_idle (lua_State *L, int usec) {
+  global_State *g = G(L);
+  lua_Number start, deadline;
+  lu_mem work = 0;
+  int stepmul = g->gcstepmul;
+  int done, i;
+  if (isgenerational(g)) {
+    luaC_forcestep(L);
+    return 1;
+  }
+  if (stepmul < 40) stepmul = 40;  /* avoid ridiculous low values (and 0) */
+  start = startclock(g);
+  deadline = start + (lua_Number)usec * 1000;
+  do {  /* always perform at least one single step */
+    work += singlestep(L);
+  } while (g->gcstate != GCSpause && luai_gcclock() < deadline);
+  chargetime(g, gcphase(g));
+  done = (g->gcstate == GCSpause);
+  if (done)
+    setpause(g, g->GCestimate);  /* pause until next cycle */
+  else {  /* convert 'work units' to Kb and take them off the debt */
+    l_mem credit = cast(l_mem, work / stepmul) * STEPMULADJ;
+    luaE_setdebt(g, g->GCdebt - credit);
+  }
+  for (i = 0; g->tobefnz && luai_gcclock() < deadline; i++)
+    GCTM(L, 1);  /* call one finalizer */
+  if (i > 0) chargetime(g, LUA_GCPFINALIZE);
+  countstep(g, start);
+  return done;
 }
 
 
@@ -1190,11 +1533,16 @@ void luaC_fullgc (lua_State *L, int isemergency) {
   global_State *g = G(L);
   int origkind = g->gckind;
   lua_assert(origkind != KGC_EMERGENCY);
-  if (isemergency)  /* do not run finalizers during emergency GC */
+  startclock(g);
+  g->gcstats.fullcycles++;
+  if (isemergency) {  /* do not run finalizers during emergency GC */
     g->gckind = KGC_EMERGENCY;
+    g->gcstats.emergencies++;
+  }
   else {
     g->gckind = KGC_NORMAL;
     callallpendingfinalizers(L, 1);
+    chargetime(g, LUA_GCPFINALIZE);
   }
   if (keepinvariant(g)) {  /* may there be some black objects? */
     /* must sweep all objects to turn them back to white
@@ -1213,6 +1561,7 @@ void luaC_fullgc (lua_State *L, int isemergency) {
   setpause(g, gettotalbytes(g));
   if (!isemergency)   /* do not run finalizers during emergency GC */
     callallpendingfinalizers(L, 1);
+  chargetime(g, LUA_GCPFINALIZE);
 }
 
 /* }====================================================== */
@@ -15,6 +15,7 @@
 #endif
 
 
+#include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -119,12 +120,109 @@
 #define IO_OUTPUT (IO_PREFIX "output")
 
 
-typedef luaL_Stream LStream;
+/* size of the read-ahead buffer of regular files */
+#if !defined(L_READBUFSIZE)
+#define L_READBUFSIZE	(64 * 1024)
+#endif
+
+
+/*
+** Read ahead gives back unread chars by seeking backwards, which is
+** only valid for binary streams; text streams may read ahead only
+** where they are the same as binary ones (POSIX, and the EDK2 StdLib,
+** which does not translate line ends).
+*/
+#if !defined(l_textisbinary)
+#if defined(LUA_USE_POSIX) || defined(UEFI_C_SOURCE)
+#define l_textisbinary	1
+#else
+#define l_textisbinary	0
+#endif
+#endif
+
+
+/*
+** File handle. Regular (seekable) files opened by this library also
+** keep a read-ahead buffer, so that reads do not go through stdio one
+** line or one character at a time; the stream position is put back
+** (see 'rbdrop') before any other operation on the 'FILE'. The buffer
+** itself is a userdata kept in the handle's uservalue.
+*/
+typedef struct LStream {
+  luaL_Stream s;  /* 'FILE' and close function (must be first) */
+  char *rb;  /* read-ahead buffer (allocated on first read) */
+  size_t rbsize;  /* size of 'rb' (0 means no read ahead) */
+  size_t rbpos;  /* next unread char in 'rb' */
+  size_t rblen;  /* end of data in 'rb' */
+  int ahead;  /* can the stream read ahead? (binary and seekable) */
+} LStream;
 
 
 #define tolstream(L)  ((LStream *)luaL_checkudata(L, 1, LUA_FILEHANDLE))
 
-#define isclosed(p) ((p)->closef == NULL)
+#define isclosed(p) ((p)->s.closef == NULL)
+
+
+static int io_fclose (lua_State *L);
+
+/*
+** only regular files opened by this library have the fields of an
+** 'LStream'; other handles (C modules create their own) may be just
+** a 'luaL_Stream'
+*/
+#define islstream(p)  ((p)->s.closef == &io_fclose)
+
+
+/*
+** give the stream at index 'h' its read-ahead buffer, if it reads ahead
+** and has none yet; the buffer is memory of Lua, counted by the
+** collector like any other
+*/
+static void rbsetup (lua_State *L, LStream *p, int h) {
+  if (p->rb == NULL && p->rbsize > 0) {
+    lua_createtable(L, 1, 0);
+    p->rb = (char *)lua_newuserdata(L, p->rbsize);
+    lua_rawseti(L, -2, 1);
+    lua_setuservalue(L, h);  /* handle keeps the buffer alive */
+  }
+}
+
+
+/*
+** refill the read-ahead buffer; returns 0 at end of file, on errors,
+** and for streams without read ahead
+*/
+static int rbfill (LStream *p) {
+  p->rbpos = 0;
+  p->rblen = (p->rb != NULL) ? fread(p->rb, 1, p->rbsize, p->s.f) : 0;
+  return (p->rblen > 0);
+}
+
+
+/*
+** discard the read-ahead data, moving the stream back to the first
+** char not yet consumed
+*/
+static void rbdrop (LStream *p) {
+  if (islstream(p)) {
+    if (p->rbpos < p->rblen)
+      l_fseek(p->s.f, -(l_seeknum)(p->rblen - p->rbpos), SEEK_CUR);
+    p->rbpos = p->rblen = 0;
+  }
+}
+
+
+/*
+** let go the read-ahead buffer of the stream at index 'h'
+*/
+static void rbfree (lua_State *L, LStream *p, int h) {
+  if (p->rb != NULL) {
+    p->rb = NULL;
+    lua_pushnil(L);
+    lua_setuservalue(L, h);  /* buffer is garbage now */
+  }
+  p->rbpos = p->rblen = 0;
+}
 
 
 static int io_type (lua_State *L) {
@@ -146,17 +244,17 @@ static int f_tostring (lua_State *L) {
   if (isclosed(p))
     lua_pushliteral(L, "file (closed)");
   else
-    lua_pushfstring(L, "file (%p)", p->f);
+    lua_pushfstring(L, "file (%p)", p->s.f);
   return 1;
 }
 
 
-static FILE *tofile (lua_State *L) {
+static LStream *tostream (lua_State *L) {
   LStream *p = tolstream(L);
   if (isclosed(p))
     luaL_error(L, "attempt to use a closed file");
-  lua_assert(p->f);
-  return p->f;
+  lua_assert(p->s.f);
+  return p;
 }
 
 
@@ -167,7 +265,10 @@ static FILE *tofile (lua_State *L) {
 */
 static LStream *newprefile (lua_State *L) {
   LStream *p = (LStream *)lua_newuserdata(L, sizeof(LStream));
-  p->closef = NULL;  /* mark file handle as 'closed' */
+  p->s.closef = NULL;  /* mark file handle as 'closed' */
+  p->rb = NULL;
+  p->rbsize = p->rbpos = p->rblen = 0;
+  p->ahead = 0;
   luaL_setmetatable(L, LUA_FILEHANDLE);
   return p;
 }
@@ -175,8 +276,10 @@ static LStream *newprefile (lua_State *L) {
 
 static int aux_close (lua_State *L) {
   LStream *p = tolstream(L);
-  lua_CFunction cf = p->closef;
-  p->closef = NULL;  /* mark stream as closed */
+  lua_CFunction cf = p->s.closef;
+  if (islstream(p))
+    rbfree(L, p, 1);
+  p->s.closef = NULL;  /* mark stream as closed */
   return (*cf)(L);  /* close it */
 }
 
@@ -184,14 +287,14 @@ static int aux_close (lua_State *L) {
 static int io_close (lua_State *L) {
   if (lua_isnone(L, 1))  /* no argument? */
     lua_getfield(L, LUA_REGISTRYINDEX, IO_OUTPUT);  /* use standard output */
-  tofile(L);  /* make sure argument is an open stream */
+  tostream(L);  /* make sure argument is an open stream */
   return aux_close(L);
 }
 
 
 static int f_gc (lua_State *L) {
   LStream *p = tolstream(L);
-  if (!isclosed(p) && p->f != NULL)
+  if (!isclosed(p) && p->s.f != NULL)
     aux_close(L);  /* ignore closed and incompletely open files */
   return 0;
 }
@@ -202,24 +305,42 @@ static int f_gc (lua_State *L) {
 */
 static int io_fclose (lua_State *L) {
   LStream *p = tolstream(L);
-  int res = fclose(p->f);
+  int res = fclose(p->s.f);
   return luaL_fileresult(L, (res == 0), NULL);
 }
 
 
 static LStream *newfile (lua_State *L) {
   LStream *p = newprefile(L);
-  p->f = NULL;
-  p->closef = &io_fclose;
+  p->s.f = NULL;
+  p->s.closef = &io_fclose;
   return p;
 }
 
 
+/*
+** give a file just opened a stdio buffer as large as the read-ahead
+** one, so that the 'FILE' reads in large blocks too; only files that
+** can seek back (not pipes or terminals) read ahead, and only binary
+** ones where text streams differ from binary streams
+*/
+static void setreadahead (LStream *p, const char *mode) {
+  if (p->s.f != NULL && (l_textisbinary || strchr(mode, 'b') != NULL)) {
+    setvbuf(p->s.f, NULL, _IOFBF, L_READBUFSIZE);  /* before any I/O */
+    if (l_ftell(p->s.f) != -1) {
+      p->ahead = 1;
+      p->rbsize = L_READBUFSIZE;
+    }
+  }
+}
+
+
 static void opencheck (lua_State *L, const char *fname, const char *mode) {
   LStream *p = newfile(L);
-  p->f = fopen(fname, mode);
-  if (p->f == NULL)
+  p->s.f = fopen(fname, mode);
+  if (p->s.f == NULL)
     luaL_error(L, "cannot open file " LUA_QS " (%s)", fname, strerror(errno));
+  setreadahead(p, mode);
 }
 
 
@@ -229,8 +350,9 @@ static int io_open (lua_State *L) {
   LStream *p = newfile(L);
   const char *md = mode;  /* to traverse/check mode */
   luaL_argcheck(L, lua_checkmode(md), 2, "invalid mode");
-  p->f = fopen(filename, mode);
-  return (p->f == NULL) ? luaL_fileresult(L, 0, filename) : 1;
+  p->s.f = fopen(filename, mode);
+  setreadahead(p, mode);
+  return (p->s.f == NULL) ? luaL_fileresult(L, 0, filename) : 1;
 }
 
 
@@ -239,7 +361,7 @@ static int io_open (lua_State *L) {
 */
 static int io_pclose (lua_State *L) {
   LStream *p = tolstream(L);
-  return luaL_execresult(L, lua_pclose(L, p->f));
+  return luaL_execresult(L, lua_pclose(L, p->s.f));
 }
 
 
@@ -247,26 +369,27 @@ static int io_popen (lua_State *L) {
   const char *filename = luaL_checkstring(L, 1);
   const char *mode = luaL_optstring(L, 2, "r");
   LStream *p = newprefile(L);
-  p->f = lua_popen(L, filename, mode);
-  p->closef = &io_pclose;
-  return (p->f == NULL) ? luaL_fileresult(L, 0, filename) : 1;
+  p->s.f = lua_popen(L, filename, mode);
+  p->s.closef = &io_pclose;
+  return (p->s.f == NULL) ? luaL_fileresult(L, 0, filename) : 1;
 }
 
 
 static int io_tmpfile (lua_State *L) {
   LStream *p = newfile(L);
-  p->f = tmpfile();
-  return (p->f == NULL) ? luaL_fileresult(L, 0, NULL) : 1;
+  p->s.f = tmpfile();
+  setreadahead(p, "wb+");  /* mode of 'tmpfile' */
+  return (p->s.f == NULL) ? luaL_fileresult(L, 0, NULL) : 1;
 }
 
 
-static FILE *getiofile (lua_State *L, const char *findex) {
+static LStream *getiofile (lua_State *L, const char *findex) {
   LStream *p;
   lua_getfield(L, LUA_REGISTRYINDEX, findex);
   p = (LStream *)lua_touserdata(L, -1);
   if (isclosed(p))
     luaL_error(L, "standard %s file is closed", findex + strlen(IO_PREFIX));
-  return p->f;
+  return p;
 }
 
 
@@ -276,7 +399,7 @@ static int g_iofile (lua_State *L, const char *f, const char *mode) {
     if (filename)
       opencheck(L, filename, mode);
     else {
-      tofile(L);  /* check that it's a valid file handle */
+      tostream(L);  /* check that it's a valid file handle */
       lua_pushvalue(L, 1);
     }
     lua_setfield(L, LUA_REGISTRYINDEX, f);
@@ -314,7 +437,7 @@ static void aux_lines (lua_State *L, int toclose) {
 
 
 static int f_lines (lua_State *L) {
-  tofile(L);  /* check that it's a valid file handle */
+  tostream(L);  /* check that it's a valid file handle */
   aux_lines(L, 0);
   return 1;
 }
@@ -326,7 +449,7 @@ static int io_lines (lua_State *L) {
   if (lua_isnil(L, 1)) {  /* no file name? */
     lua_getfield(L, LUA_REGISTRYINDEX, IO_INPUT);  /* get default input */
     lua_replace(L, 1);  /* put it at index 1 */
-    tofile(L);  /* check that it's a valid file handle */
+    tostream(L);  /* check that it's a valid file handle */
     toclose = 0;  /* do not close it after iteration */
   }
   else {  /* open a new file */
@@ -347,9 +470,113 @@ static int io_lines (lua_State *L) {
 */
 
 
-static int read_number (lua_State *L, FILE *f) {
+/* maximum length of a numeral read by 'read_number' */
+#if !defined(L_MAXLENNUM)
+#define L_MAXLENNUM	200
+#endif
+
+
+/* state of the numeral being read by 'read_number' */
+typedef struct RN {
+  LStream *p;  /* file being read */
+  int c;  /* current character (look ahead) */
+  int n;  /* number of elements in buffer 'buff' */
+  char buff[L_MAXLENNUM + 1];  /* numeral being read */
+} RN;
+
+
+/*
+** read one char, from the read-ahead buffer when there is one
+*/
+static int l_getc (LStream *p) {
+  if (p->rbpos < p->rblen || rbfill(p))
+    return (unsigned char)p->rb[p->rbpos++];
+  else if (p->rbsize > 0)
+    return EOF;
+  else
+    return getc(p->s.f);
+}
+
+
+/*
+** push back the last char read by 'l_getc'
+*/
+static void l_ungetc (LStream *p, int c) {
+  if (p->rbsize == 0)
+    ungetc(c, p->s.f);
+  else if (c != EOF)
+    p->rbpos--;  /* char is still in the buffer */
+}
+
+
+/*
+** add current char to buffer (if not out of space) and read next one
+*/
+static int nextc (RN *rn) {
+  if (rn->n >= L_MAXLENNUM) {  /* buffer overflow? */
+    rn->buff[0] = '\0';  /* invalidate result */
+    return 0;  /* fail */
+  }
+  else {
+    rn->buff[rn->n++] = (char)rn->c;  /* save current char */
+    rn->c = l_getc(rn->p);  /* read next one */
+    return 1;
+  }
+}
+
+
+/*
+** accept current char if it is in 'set' (of size 2)
+*/
+static int test2 (RN *rn, const char *set) {
+  if (rn->c == set[0] || rn->c == set[1])
+    return nextc(rn);
+  else return 0;
+}
+
+
+/*
+** read a sequence of (hex)digits
+*/
+static int readdigits (RN *rn, int hex) {
+  int count = 0;
+  while ((hex ? isxdigit(rn->c) : isdigit(rn->c)) && nextc(rn))
+    count++;
+  return count;
+}
+
+
+/*
+** Read a numeral (at most L_MAXLENNUM characters, with no more look
+** ahead than one character) and convert it with the same code that
+** converts strings to numbers, instead of going through 'fscanf'.
+*/
+static int read_number (lua_State *L, LStream *p) {
+  RN rn;
+  int count = 0;
+  int hex = 0;
+  int ok;
   lua_Number d;
-  if (fscanf(f, LUA_NUMBER_SCAN, &d) == 1) {
+  rn.p = p; rn.n = 0;
+  do { rn.c = l_getc(p); } while (isspace(rn.c));  /* skip spaces */
+  test2(&rn, "-+");  /* optional signal */
+  if (test2(&rn, "00")) {
+    if (test2(&rn, "xX")) hex = 1;  /* numeral is hexadecimal */
+    else count = 1;  /* count initial '0' as a valid digit */
+  }
+  count += readdigits(&rn, hex);  /* integral part */
+  if (test2(&rn, ".."))  /* decimal point? */
+    count += readdigits(&rn, hex);  /* fractional part */
+  if (count > 0 && test2(&rn, (hex ? "pP" : "eE"))) {  /* exponent mark? */
+    test2(&rn, "-+");  /* exponent signal */
+    readdigits(&rn, 0);  /* exponent digits */
+  }
+  l_ungetc(p, rn.c);  /* unread look-ahead char */
+  rn.buff[rn.n] = '\0';  /* finish */
+  lua_pushstring(L, rn.buff);
+  d = lua_tonumberx(L, -1, &ok);
+  lua_pop(L, 1);
+  if (ok) {
     lua_pushnumber(L, d);
     return 1;
   }
@@ -360,15 +587,15 @@ static int read_number (lua_State *L, FILE *f) {
 }
 
 
-static int test_eof (lua_State *L, FILE *f) {
-  int c = getc(f);
-  ungetc(c, f);
+static int test_eof (lua_State *L, LStream *p) {
+  int c = l_getc(p);
+  l_ungetc(p, c);
   lua_pushlstring(L, NULL, 0);
   return (c != EOF);
 }
 
 
-static int read_line (lua_State *L, FILE *f, int chop) {
+static int read_linef (lua_State *L, FILE *f, int chop) {
   luaL_Buffer b;
   luaL_buffinit(L, &b);
   for (;;) {
@@ -390,15 +617,66 @@ static int read_line (lua_State *L, FILE *f, int chop) {
 }
 
 
+/*
+** Read a line from the read-ahead buffer: a line that is all in the
+** buffer becomes a string straight from it; only lines that cross a
+** refill go through a 'luaL_Buffer'.
+*/
+static int read_line (lua_State *L, LStream *p, int chop) {
+  luaL_Buffer b;
+  int partial = 0;  /* is part of the line already in 'b'? */
+  if (p->rbsize == 0)
+    return read_linef(L, p->s.f, chop);
+  for (;;) {
+    const char *s = p->rb + p->rbpos;
+    size_t avail = p->rblen - p->rbpos;
+    const char *nl;
+    if (avail == 0) {
+      if (rbfill(p)) continue;
+      if (!partial) {  /* eof with nothing read? */
+        lua_pushlstring(L, NULL, 0);
+        return 0;
+      }
+      luaL_pushresult(&b);  /* last line has no 'eol' */
+      return 1;
+    }
+    nl = (const char *)memchr(s, '\n', avail);
+    if (nl == NULL) {  /* line goes on after this buffer */
+      if (!partial) {
+        luaL_buffinit(L, &b);
+        partial = 1;
+      }
+      luaL_addlstring(&b, s, avail);
+      p->rbpos = p->rblen;
+    }
+    else {
+      size_t l = nl - s;
+      p->rbpos += l + 1;
+      if (!chop) l++;  /* keep 'eol' */
+      if (!partial)
+        lua_pushlstring(L, s, l);
+      else {
+        luaL_addlstring(&b, s, l);
+        luaL_pushresult(&b);
+      }
+      return 1;
+    }
+  }
+}
+
+
 #define MAX_SIZE_T  (~(size_t)0)
 
-static void read_all (lua_State *L, FILE *f) {
+static void read_all (lua_State *L, LStream *p) {
   size_t rlen = LUAL_BUFFERSIZE;  /* how much to read in each cycle */
   luaL_Buffer b;
   luaL_buffinit(L, &b);
+  if (p->rbpos < p->rblen)  /* start with what was read ahead */
+    luaL_addlstring(&b, p->rb + p->rbpos, p->rblen - p->rbpos);
+  p->rbpos = p->rblen = 0;  /* read the rest straight from the file */
   for (;;) {
-    char *p = luaL_prepbuffsize(&b, rlen);
-    size_t nr = fread(p, sizeof(char), rlen, f);
+    char *s = luaL_prepbuffsize(&b, rlen);
+    size_t nr = fread(s, sizeof(char), rlen, p->s.f);
     luaL_addsize(&b, nr);
     if (nr < rlen) break;  /* eof? */
     else if (rlen <= (MAX_SIZE_T / 4))  /* avoid buffers too large */
@@ -408,26 +686,64 @@ static void read_all (lua_State *L, FILE *f) {
 }
 
 
-static int read_chars (lua_State *L, FILE *f, size_t n) {
-  size_t nr;  /* number of chars actually read */
-  char *p;
+/*
+** read 'n' chars: from the read-ahead buffer while it has data, then
+** straight from the file when what is missing fills a whole buffer
+*/
+static int read_chars (lua_State *L, LStream *p, size_t n) {
+  size_t total = 0;  /* number of chars actually read */
   luaL_Buffer b;
+  if (p->rblen - p->rbpos >= n) {  /* all in the buffer? */
+    lua_pushlstring(L, p->rb + p->rbpos, n);
+    p->rbpos += n;
+    return 1;
+  }
   luaL_buffinit(L, &b);
-  p = luaL_prepbuffsize(&b, n);  /* prepare buffer to read whole block */
-  nr = fread(p, sizeof(char), n, f);  /* try to read 'n' chars */
-  luaL_addsize(&b, nr);
+  while (n > 0) {
+    size_t avail = p->rblen - p->rbpos;
+    if (avail == 0) {
+      if (n >= p->rbsize) {  /* read the rest without the buffer */
+        char *s = luaL_prepbuffsize(&b, n);  /* prepare to read whole block */
+        size_t nr = fread(s, sizeof(char), n, p->s.f);
+        luaL_addsize(&b, nr);
+        total += nr;
+        break;
+      }
+      if (!rbfill(p)) break;  /* eof? */
+      avail = p->rblen;
+    }
+    if (avail > n) avail = n;
+    luaL_addlstring(&b, p->rb + p->rbpos, avail);
+    p->rbpos += avail;
+    total += avail;
+    n -= avail;
+  }
   luaL_pushresult(&b);  /* close buffer */
-  return (nr > 0);  /* true iff read something */
+  return (total > 0);  /* true iff read something */
 }
 
 
-static int g_read (lua_State *L, FILE *f, int first) {
+/*
+** read from the stream 'ls', whose handle is at index 'h'
+*/
+static int g_read (lua_State *L, LStream *ls, int h, int first) {
+  FILE *f = ls->s.f;
   int nargs = lua_gettop(L) - 1;
   int success;
   int n;
+  LStream fs;
+  if (islstream(ls))
+    rbsetup(L, ls, h);
+  else {  /* read a plain 'luaL_Stream' through a copy with no buffer */
+    fs.s = ls->s;
+    fs.rb = NULL;
+    fs.rbsize = fs.rbpos = fs.rblen = 0;
+    fs.ahead = 0;
+    ls = &fs;
+  }
   clearerr(f);
   if (nargs == 0) {  /* no arguments? */
-    success = read_line(L, f, 1);
+    success = read_line(L, ls, 1);
     n = first+1;  /* to return 1 result */
   }
   else {  /* ensure stack space for all results and for auxlib's buffer */
@@ -436,23 +752,23 @@ static int g_read (lua_State *L, FILE *f, int first) {
     for (n = first; nargs-- && success; n++) {
       if (lua_type(L, n) == LUA_TNUMBER) {
         size_t l = (size_t)lua_tointeger(L, n);
-        success = (l == 0) ? test_eof(L, f) : read_chars(L, f, l);
+        success = (l == 0) ? test_eof(L, ls) : read_chars(L, ls, l);
       }
       else {
         const char *p = lua_tostring(L, n);
         luaL_argcheck(L, p && p[0] == '*', n, "invalid option");
         switch (p[1]) {
           case 'n':  /* number */
-            success = read_number(L, f);
+            success = read_number(L, ls);
             break;
           case 'l':  /* line */
-            success = read_line(L, f, 1);
+            success = read_line(L, ls, 1);
             break;
           case 'L':  /* line with end-of-line */
-            success = read_line(L, f, 0);
+            success = read_line(L, ls, 0);
             break;
           case 'a':  /* file */
-            read_all(L, f);  /* read entire file */
+            read_all(L, ls);  /* read entire file */
             success = 1; /* always success */
             break;
           default:
@@ -472,12 +788,13 @@ static int g_read (lua_State *L, FILE *f, int first) {
 
 
 static int io_read (lua_State *L) {
-  return g_read(L, getiofile(L, IO_INPUT), 1);
+  LStream *p = getiofile(L, IO_INPUT);
+  return g_read(L, p, lua_gettop(L), 1);
 }
 
 
 static int f_read (lua_State *L) {
-  return g_read(L, tofile(L), 2);
+  return g_read(L, tostream(L), 1, 2);
 }
 
 
@@ -490,7 +807,7 @@ static int io_readline (lua_State *L) {
   lua_settop(L , 1);
   for (i = 1; i <= n; i++)  /* push arguments to 'g_read' */
     lua_pushvalue(L, lua_upvalueindex(3 + i));
-  n = g_read(L, p->f, 2);  /* 'n' is number of results */
+  n = g_read(L, p, lua_upvalueindex(1), 2);  /* 'n' is number of results */
   lua_assert(n > 0);  /* should return at least a nil */
   if (!lua_isnil(L, -n))  /* read at least one value? */
     return n;  /* return them */
@@ -511,20 +828,16 @@ static int io_readline (lua_State *L) {
 /* }====================================================== */
 
 
-static int g_write (lua_State *L, FILE *f, int arg) {
+static int g_write (lua_State *L, LStream *p, int arg) {
+  FILE *f = p->s.f;
   int nargs = lua_gettop(L) - arg;
   int status = 1;
+  rbdrop(p);
   for (; nargs--; arg++) {
-    if (lua_type(L, arg) == LUA_TNUMBER) {
-      /* optimization: could be done exactly as for strings */
-      status = status &&
-          fprintf(f, LUA_NUMBER_FMT, lua_tonumber(L, arg)) > 0;
-    }
-    else {
-      size_t l;
-      const char *s = luaL_checklstring(L, arg, &l);
-      status = status && (fwrite(s, sizeof(char), l, f) == l);
-    }
+    /* numbers are converted as 'tostring' does, so they read back */
+    size_t l;
+    const char *s = luaL_checklstring(L, arg, &l);
+    status = status && (fwrite(s, sizeof(char), l, f) == l);
   }
   if (status) return 1;  /* file handle already on stack top */
   else return luaL_fileresult(L, status, NULL);
@@ -537,21 +850,23 @@ static int io_write (lua_State *L) {
 
 
 static int f_write (lua_State *L) {
-  FILE *f = tofile(L);
+  LStream *p = tostream(L);
   lua_pushvalue(L, 1);  /* push file at the stack top (to be returned) */
-  return g_write(L, f, 2);
+  return g_write(L, p, 2);
 }
 
 
 static int f_seek (lua_State *L) {
   static const int mode[] = {SEEK_SET, SEEK_CUR, SEEK_END};
   static const char *const modenames[] = {"set", "cur", "end", NULL};
-  FILE *f = tofile(L);
+  LStream *p = tostream(L);
+  FILE *f = p->s.f;
   int op = luaL_checkoption(L, 2, "cur", modenames);
   lua_Number p3 = luaL_optnumber(L, 3, 0);
   l_seeknum offset = (l_seeknum)p3;
   luaL_argcheck(L, (lua_Number)offset == p3, 3,
                   "not an integer in proper range");
+  rbdrop(p);
   op = l_fseek(f, offset, mode[op]);
   if (op)
     return luaL_fileresult(L, 0, NULL);  /* error */
@@ -565,22 +880,33 @@ static int f_seek (lua_State *L) {
 static int f_setvbuf (lua_State *L) {
   static const int mode[] = {_IONBF, _IOFBF, _IOLBF};
   static const char *const modenames[] = {"no", "full", "line", NULL};
-  FILE *f = tofile(L);
+  LStream *p = tostream(L);
   int op = luaL_checkoption(L, 2, NULL, modenames);
   lua_Integer sz = luaL_optinteger(L, 3, LUAL_BUFFERSIZE);
-  int res = setvbuf(f, NULL, mode[op], sz);
+  int res;
+  rbdrop(p);
+  res = setvbuf(p->s.f, NULL, mode[op], sz);
+  if (islstream(p) && p->ahead &&
+      (mode[op] == _IONBF || !lua_isnoneornil(L, 3))) {
+    rbfree(L, p, 1);  /* read ahead as much as the new buffer holds */
+    p->rbsize = (mode[op] == _IONBF || sz <= 0) ? 0 : (size_t)sz;
+  }
   return luaL_fileresult(L, res == 0, NULL);
 }
 
 
 
 static int io_flush (lua_State *L) {
-  return luaL_fileresult(L, fflush(getiofile(L, IO_OUTPUT)) == 0, NULL);
+  LStream *p = getiofile(L, IO_OUTPUT);
+  rbdrop(p);
+  return luaL_fileresult(L, fflush(p->s.f) == 0, NULL);
 }
 
 
 static int f_flush (lua_State *L) {
-  return luaL_fileresult(L, fflush(tofile(L)) == 0, NULL);
+  LStream *p = tostream(L);
+  rbdrop(p);
+  return luaL_fileresult(L, fflush(p->s.f) == 0, NULL);
 }
 
 
@@ -634,7 +960,7 @@ static void createmeta (lua_State *L) {
 */
 static int io_noclose (lua_State *L) {
   LStream *p = tolstream(L);
-  p->closef = &io_noclose;  /* keep file opened */
+  p->s.closef = &io_noclose;  /* keep file opened */
   lua_pushnil(L);
   lua_pushliteral(L, "cannot close standard file");
   return 2;
@@ -644,8 +970,8 @@ static int io_noclose (lua_State *L) {
 static void createstdfile (lua_State *L, FILE *f, const char *k,
                            const char *fname) {
   LStream *p = newprefile(L);
-  p->f = f;
-  p->closef = &io_noclose;
+  p->s.f = f;
+  p->s.closef = &io_noclose;
   if (k != NULL) {
     lua_pushvalue(L, -1);
     lua_setfield(L, LUA_REGISTRYINDEX, k);  /* add file to registry */
@@ -22,6 +22,17 @@ typedef LUAI_UMEM lu_mem;
 typedef LUAI_MEM l_mem;
 
 
+/*
+** unsigned counterpart of lua_Integer, used for wrap-around arithmetic
+** on the integer subtype of numbers (signed overflow is undefined in C)
+*/
+#if !defined(LUAI_UINTEGER)
+#define LUAI_UINTEGER	size_t
+#endif
+
+typedef LUAI_UINTEGER lu_integer;
+
+
 
 /* chars used as small naturals (so that `char' is reserved for characters) */
 typedef unsigned char lu_byte;
@@ -36,6 +47,10 @@ typedef unsigned char lu_byte;
 
 #define MAX_INT (INT_MAX-2)  /* maximum value of an int (-2 for safety) */
 
+/* limits of lua_Integer */
+#define MAX_LUAINTEGER	((lua_Integer)((~(lu_integer)0) >> 1))
+#define MIN_LUAINTEGER	(-MAX_LUAINTEGER - 1)
+
 /*
 ** conversion of pointer to integer
 ** this is for hashing only; there is no problem if the integer
@@ -267,6 +282,16 @@ union luai_Cast { double l_d; LUA_INT32 l_p[2]; };
 #endif				/* } */
 
 
+/*
+** lua_integer2str converts a lua_Integer to a string; the buffer must
+** have at least LUAI_MAXNUMBER2STR bytes
+*/
+#if !defined(lua_integer2str)
+#define LUA_INTEGER_FMT		"%lld"
+#define lua_integer2str(s,n)	luaO_int2str((s), (n))
+#endif
+
+
 #if !defined(lua_unsigned2number)
 /* on several machines, coercion from unsigned to double is slow,
    so it may be worth to avoid */
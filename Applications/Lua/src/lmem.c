@@ -70,7 +70,25 @@ l_noret luaM_toobig (lua_State *L) {
 
 
 /*
-** generic allocation routine.
+** call the allocation function, unless the block would grow past the
+** memory limit of the state (in which case the allocation "fails")
+*/
+static void *tryrealloc (global_State *g, void *block, size_t osize,
+                                                       size_t nsize) {
+  size_t realosize = (block) ? osize : 0;
+  if (g->memlimit > 0 && nsize > realosize) {
+    lu_mem inuse = gettotalbytes(g);
+    if (inuse >= g->memlimit || nsize - realosize > g->memlimit - inuse)
+      return NULL;  /* over the limit */
+  }
+  return (*g->frealloc)(g->ud, block, osize, nsize);
+}
+
+
+/*
+** generic allocation routine. When memory runs out (or the limit is
+** reached), try an emergency collection and then the low-memory
+** handler before raising a memory error.
 */
 void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   void *newblock;
@@ -81,19 +99,24 @@ void *luaM_realloc_ (lua_State *L, void *block, size_t osize, size_t nsize) {
   if (nsize > realosize && g->gcrunning)
     luaC_fullgc(L, 1);  /* force a GC whenever possible */
 #endif
-  newblock = (*g->frealloc)(g->ud, block, osize, nsize);
+  newblock = tryrealloc(g, block, osize, nsize);
   if (newblock == NULL && nsize > 0) {
     api_check(L, nsize > realosize,
                  "realloc cannot fail when shrinking a block");
     if (g->gcrunning) {
       luaC_fullgc(L, 1);  /* try to free some memory... */
-      newblock = (*g->frealloc)(g->ud, block, osize, nsize);  /* try again */
+      newblock = tryrealloc(g, block, osize, nsize);  /* try again */
     }
+    if (newblock == NULL && g->lowmem != NULL &&
+        (*g->lowmem)(g->lowmemud, L, nsize))  /* handler freed something? */
+      newblock = tryrealloc(g, block, osize, nsize);  /* last try */
     if (newblock == NULL)
       luaD_throw(L, LUA_ERRMEM);
   }
   lua_assert((nsize == 0) == (newblock == NULL));
   g->GCdebt = (g->GCdebt + nsize) - realosize;
+  if (gettotalbytes(g) > g->mempeak)
+    g->mempeak = gettotalbytes(g);
   return newblock;
 }
 
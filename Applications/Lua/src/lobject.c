@@ -4,6 +4,7 @@
 ** See Copyright Notice in lua.h
 */
 
+#include <float.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -84,6 +85,76 @@ lua_Number luaO_arith (int op, lua_Number v1, lua_Number v2) {
 }
 
 
+/* integers up to this absolute value can be multiplied without overflow */
+#define MAXSAFEMUL	(cast(lua_Integer, 1) << (sizeof(lua_Integer) * 4 - 1))
+
+#define intop(op,v1,v2) \
+	cast(lua_Integer, cast(lu_integer, v1) op cast(lu_integer, v2))
+
+/*
+** integer arithmetic over integer operands. Returns 0 when the result
+** cannot be represented exactly as an integer (overflow, division,
+** exponentiation or a zero modulus) or when float arithmetic would
+** give -0 (negating zero, or a zero product with a negative factor),
+** so that callers can fall back to float arithmetic.
+*/
+int luaO_intarith (int op, lua_Integer v1, lua_Integer v2,
+                   lua_Integer *res) {
+  lua_Integer r;
+  switch (op) {
+    case LUA_OPADD:
+      r = intop(+, v1, v2);
+      if (((v1 ^ r) & (v2 ^ r)) < 0) return 0;  /* overflow */
+      break;
+    case LUA_OPSUB:
+      r = intop(-, v1, v2);
+      if (((v1 ^ v2) & (v1 ^ r)) < 0) return 0;  /* overflow */
+      break;
+    case LUA_OPMUL:
+      r = intop(*, v1, v2);
+      if (!(-MAXSAFEMUL < v1 && v1 < MAXSAFEMUL &&
+            -MAXSAFEMUL < v2 && v2 < MAXSAFEMUL) &&  /* may overflow? */
+          v1 != 0 && ((v1 == -1 && v2 == MIN_LUAINTEGER) || r / v1 != v2))
+        return 0;  /* overflow */
+      if (r == 0 && (v1 < 0 || v2 < 0)) return 0;  /* -0 */
+      break;
+    case LUA_OPMOD:
+      if (v2 == 0) return 0;  /* 'nan' */
+      else if (v2 == -1) r = 0;  /* avoid overflow with MIN_LUAINTEGER % -1 */
+      else {
+        r = v1 % v2;
+        if (r != 0 && (r ^ v2) < 0) r += v2;  /* result has sign of 'v2' */
+      }
+      break;
+    case LUA_OPUNM:
+      if (v1 == MIN_LUAINTEGER || v1 == 0) return 0;  /* overflow or -0 */
+      r = -v1;
+      break;
+    default: return 0;  /* division and power always give floats */
+  }
+  *res = r;
+  return 1;
+}
+
+
+/*
+** arithmetic over two numbers of any subtype; the result is an integer
+** only when both operands are integers and 'luaO_intarith' succeeds
+*/
+void luaO_arithnum (int op, const TValue *p1, const TValue *p2,
+                    TValue *res) {
+  lua_Integer i;
+  if (ttisinteger(p1) && ttisinteger(p2) &&
+      luaO_intarith(op, ivalue(p1), ivalue(p2), &i)) {
+    setivalue(res, i);
+  }
+  else {
+    lua_Number n = luaO_arith(op, nvalue(p1), nvalue(p2));
+    setnvalue(res, n);
+  }
+}
+
+
 int luaO_hexavalue (int c) {
   if (lisdigit(c)) return c - '0';
   else return ltolower(c) - 'a' + 10;
@@ -155,8 +226,410 @@ static lua_Number lua_strx2number (const char *s, char **endptr) {
 #endif
 
 
+/*
+** {======================================================
+** Fast number/string conversions
+** =======================================================
+*/
+
+#if defined(LUA_NUMBER_DOUBLE)	/* { */
+
+typedef unsigned long long l_uint64;
+
+#define DBL_HIDDEN	((l_uint64)1 << 52)	/* implicit bit of a double */
+
+/* a "do-it-yourself floating point" number: f * 2^e */
+typedef struct DiyFp {
+  l_uint64 f;
+  int e;
+} DiyFp;
+
+
+static const l_uint64 pow10u[20] = {
+  1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+  10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+  100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+  100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+  100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+
+/*
+** A product or quotient of an integer no larger than 2^53 and an exact
+** power of ten is correctly rounded, provided arithmetic is evaluated in
+** plain double precision; that is not so when the FPU keeps excess
+** precision (x87).
+*/
+#if !defined(FLT_EVAL_METHOD) || FLT_EVAL_METHOD == 0
+
+#define L_EXACTSCALE
+
+static const double pow10d[23] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12,
+  1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#endif
+
+
+/* normalized approximations of 10^-348, 10^-340, ..., 10^340 */
+static const DiyFp cachedpow[87] = {
+  {0xfa8fd5a0081c0288ULL, -1220}, {0xbaaee17fa23ebf76ULL, -1193},
+  {0x8b16fb203055ac76ULL, -1166}, {0xcf42894a5dce35eaULL, -1140},
+  {0x9a6bb0aa55653b2dULL, -1113}, {0xe61acf033d1a45dfULL, -1087},
+  {0xab70fe17c79ac6caULL, -1060}, {0xff77b1fcbebcdc4fULL, -1034},
+  {0xbe5691ef416bd60cULL, -1007}, {0x8dd01fad907ffc3cULL, -980},
+  {0xd3515c2831559a83ULL, -954}, {0x9d71ac8fada6c9b5ULL, -927},
+  {0xea9c227723ee8bcbULL, -901}, {0xaecc49914078536dULL, -874},
+  {0x823c12795db6ce57ULL, -847}, {0xc21094364dfb5637ULL, -821},
+  {0x9096ea6f3848984fULL, -794}, {0xd77485cb25823ac7ULL, -768},
+  {0xa086cfcd97bf97f4ULL, -741}, {0xef340a98172aace5ULL, -715},
+  {0xb23867fb2a35b28eULL, -688}, {0x84c8d4dfd2c63f3bULL, -661},
+  {0xc5dd44271ad3cdbaULL, -635}, {0x936b9fcebb25c996ULL, -608},
+  {0xdbac6c247d62a584ULL, -582}, {0xa3ab66580d5fdaf6ULL, -555},
+  {0xf3e2f893dec3f126ULL, -529}, {0xb5b5ada8aaff80b8ULL, -502},
+  {0x87625f056c7c4a8bULL, -475}, {0xc9bcff6034c13053ULL, -449},
+  {0x964e858c91ba2655ULL, -422}, {0xdff9772470297ebdULL, -396},
+  {0xa6dfbd9fb8e5b88fULL, -369}, {0xf8a95fcf88747d94ULL, -343},
+  {0xb94470938fa89bcfULL, -316}, {0x8a08f0f8bf0f156bULL, -289},
+  {0xcdb02555653131b6ULL, -263}, {0x993fe2c6d07b7facULL, -236},
+  {0xe45c10c42a2b3b06ULL, -210}, {0xaa242499697392d3ULL, -183},
+  {0xfd87b5f28300ca0eULL, -157}, {0xbce5086492111aebULL, -130},
+  {0x8cbccc096f5088ccULL, -103}, {0xd1b71758e219652cULL, -77},
+  {0x9c40000000000000ULL, -50}, {0xe8d4a51000000000ULL, -24},
+  {0xad78ebc5ac620000ULL, 3}, {0x813f3978f8940984ULL, 30},
+  {0xc097ce7bc90715b3ULL, 56}, {0x8f7e32ce7bea5c70ULL, 83},
+  {0xd5d238a4abe98068ULL, 109}, {0x9f4f2726179a2245ULL, 136},
+  {0xed63a231d4c4fb27ULL, 162}, {0xb0de65388cc8ada8ULL, 189},
+  {0x83c7088e1aab65dbULL, 216}, {0xc45d1df942711d9aULL, 242},
+  {0x924d692ca61be758ULL, 269}, {0xda01ee641a708deaULL, 295},
+  {0xa26da3999aef774aULL, 322}, {0xf209787bb47d6b85ULL, 348},
+  {0xb454e4a179dd1877ULL, 375}, {0x865b86925b9bc5c2ULL, 402},
+  {0xc83553c5c8965d3dULL, 428}, {0x952ab45cfa97a0b3ULL, 455},
+  {0xde469fbd99a05fe3ULL, 481}, {0xa59bc234db398c25ULL, 508},
+  {0xf6c69a72a3989f5cULL, 534}, {0xb7dcbf5354e9beceULL, 561},
+  {0x88fcf317f22241e2ULL, 588}, {0xcc20ce9bd35c78a5ULL, 614},
+  {0x98165af37b2153dfULL, 641}, {0xe2a0b5dc971f303aULL, 667},
+  {0xa8d9d1535ce3b396ULL, 694}, {0xfb9b7cd9a4a7443cULL, 720},
+  {0xbb764c4ca7a44410ULL, 747}, {0x8bab8eefb6409c1aULL, 774},
+  {0xd01fef10a657842cULL, 800}, {0x9b10a4e5e9913129ULL, 827},
+  {0xe7109bfba19c0c9dULL, 853}, {0xac2820d9623bf429ULL, 880},
+  {0x80444b5e7aa7cf85ULL, 907}, {0xbf21e44003acdd2dULL, 933},
+  {0x8e679c2f5e44ff8fULL, 960}, {0xd433179d9c8cb841ULL, 986},
+  {0x9e19db92b4e31ba9ULL, 1013}, {0xeb96bf6ebadf77d9ULL, 1039},
+  {0xaf87023b9bf0ee6bULL, 1066}
+};
+
+
+/* product rounded to the upper 64 bits */
+static DiyFp diymul (DiyFp x, DiyFp y) {
+  const l_uint64 m32 = 0xFFFFFFFFu;
+  l_uint64 a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+  l_uint64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+  l_uint64 mid = (bd >> 32) + (ad & m32) + (bc & m32) + (1u << 31);
+  DiyFp r;
+  r.f = ac + (ad >> 32) + (bc >> 32) + (mid >> 32);
+  r.e = x.e + y.e + 64;
+  return r;
+}
+
+
+static DiyFp diynormalize (DiyFp x) {
+  while (!(x.f & ((l_uint64)1 << 63))) {
+    x.f <<= 1;
+    x.e--;
+  }
+  return x;
+}
+
+
+/*
+** move the last digit down while the result stays inside the rounding
+** interval and gets closer to the exact value
+*/
+static void grisuround (char *buff, int len, l_uint64 delta, l_uint64 rest,
+                        l_uint64 tenkappa, l_uint64 wpw) {
+  while (rest < wpw && delta - rest >= tenkappa &&
+         (rest + tenkappa < wpw || wpw - rest > rest + tenkappa - wpw)) {
+    buff[len - 1]--;
+    rest += tenkappa;
+  }
+}
+
+
+static int digitgen (DiyFp w, DiyFp mp, l_uint64 delta, char *buff,
+                     int *k) {
+  int shift = -mp.e;
+  l_uint64 one = (l_uint64)1 << shift;
+  l_uint64 wpw = mp.f - w.f;
+  lu_int32 p1 = cast(lu_int32, mp.f >> shift);  /* integral part */
+  l_uint64 p2 = mp.f & (one - 1);  /* fractional part */
+  int kappa = 1;
+  int len = 0;
+  while (kappa < 10 && p1 >= pow10u[kappa]) kappa++;
+  while (kappa > 0) {
+    lu_int32 d = p1 / cast(lu_int32, pow10u[kappa - 1]);
+    l_uint64 rest;
+    p1 %= cast(lu_int32, pow10u[kappa - 1]);
+    if (d || len) buff[len++] = cast(char, '0' + d);
+    kappa--;
+    rest = (cast(l_uint64, p1) << shift) + p2;
+    if (rest <= delta) {
+      *k += kappa;
+      grisuround(buff, len, delta, rest, pow10u[kappa] << shift, wpw);
+      return len;
+    }
+  }
+  for (;;) {
+    int d;
+    p2 *= 10;
+    delta *= 10;
+    d = cast_int(p2 >> shift);
+    if (d || len) buff[len++] = cast(char, '0' + d);
+    p2 &= one - 1;
+    kappa--;
+    if (p2 < delta) {
+      *k += kappa;
+      grisuround(buff, len, delta, p2, one,
+                 (-kappa < 20) ? wpw * pow10u[-kappa] : 0);
+      return len;
+    }
+  }
+}
+
+
+/*
+** Grisu2 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+** Accurately with Integers"): writes into 'buff' at most 17 digits that
+** read back as 'v' (positive and finite) and returns how many; the
+** value is digits * 10^(*k).  The result is the shortest such string
+** for all but a tiny fraction of inputs.
+*/
+static int grisu2 (double v, char *buff, int *k) {
+  union { double d; l_uint64 u; } bits;
+  DiyFp w, wp, wm, c;
+  int be, ki, idx;
+  double dk;
+  bits.d = v;
+  be = cast_int((bits.u >> 52) & 0x7FF);
+  w.f = bits.u & (DBL_HIDDEN - 1);
+  if (be != 0) { w.f += DBL_HIDDEN; w.e = be - 1075; }
+  else w.e = -1074;  /* subnormal */
+  /* boundaries of the rounding interval, with a common exponent */
+  wp.f = (w.f << 1) + 1; wp.e = w.e - 1;
+  wp = diynormalize(wp);
+  if (w.f == DBL_HIDDEN) { wm.f = (w.f << 2) - 1; wm.e = w.e - 2; }
+  else { wm.f = (w.f << 1) - 1; wm.e = w.e - 1; }
+  wm.f <<= wm.e - wp.e; wm.e = wp.e;
+  /* choose 10^-k that brings the exponent of 'wp' into [-60, -32] */
+  dk = (-61 - wp.e) * 0.30102999566398114 + 347;
+  ki = cast_int(dk);
+  if (dk - ki > 0.0) ki++;
+  idx = (ki >> 3) + 1;
+  *k = 348 - idx * 8;
+  c = cachedpow[idx];
+  w = diymul(diynormalize(w), c);
+  wp = diymul(wp, c);
+  wm = diymul(wm, c);
+  wm.f++; wp.f--;  /* stay strictly inside the interval */
+  return digitgen(w, wp, wp.f - wm.f, buff, k);
+}
+
+
+#if defined(L_EXACTSCALE)
+
+/*
+** Grisu2 works on a slightly narrowed interval and so may miss a shorter
+** representation near its ends (1e23 comes out as 9.999999999999999e+22).
+** When it gives more than 15 digits, try the roundings to 15 and 16
+** digits (the first is the shortest representation whenever one of 15
+** or fewer digits exists) and keep one that reads back as 'v', which is
+** cheap to check while it is an exact double times an exact power of ten.
+*/
+static int shorten (double v, char *digits, int nd, int *k) {
+  int t;
+  for (t = 15; t < nd; t++) {
+    l_uint64 m = 0;
+    int e = *k + nd - t;  /* exponent of the last of 't' digits */
+    int i;
+    for (i = 0; i < t; i++) m = m * 10 + (digits[i] - '0');
+    if (digits[t] >= '5') m++;  /* round */
+    if (e < -22 || e > 22 || m > (DBL_HIDDEN << 1))
+      continue;  /* cannot check it cheaply */
+    if ((e < 0 ? cast_num(m) / pow10d[-e] : cast_num(m) * pow10d[e]) == v) {
+      while (m % 10 == 0) { m /= 10; e++; }  /* drop trailing zeros */
+      for (nd = 0; m > 0; m /= 10) digits[nd++] = cast(char, '0' + m % 10);
+      for (i = 0; i < nd / 2; i++) {  /* digits came out reversed */
+        char c = digits[i];
+        digits[i] = digits[nd - 1 - i];
+        digits[nd - 1 - i] = c;
+      }
+      *k = e;
+      break;
+    }
+  }
+  return nd;
+}
+
+#else
+#define shorten(v,digits,nd,k)	(nd)
+#endif
+
+
+/*
+** convert a float to its shortest round-trip representation, laid out
+** as "%.14g" would lay it out (widened to 17 digits when needed);
+** returns the length.  Infinities and NaNs still go to 'lua_number2str'.
+*/
+int luaO_num2str (char *s, lua_Number n) {
+  union { double d; l_uint64 u; } bits;
+  char digits[20];
+  char *p = s;
+  int nd, k, x, prec, i;
+  if (!luai_numeq(n - n, 0))  /* inf or NaN? */
+    return lua_number2str(s, n);
+  bits.d = n;
+  if (bits.u >> 63) { *p++ = '-'; n = -n; }
+  if (n == 0) {
+    *p++ = '0';
+    *p = '\0';
+    return cast_int(p - s);
+  }
+  nd = grisu2(n, digits, &k);
+  nd = shorten(n, digits, nd, &k);
+  x = nd + k - 1;  /* decimal exponent of the first digit */
+  prec = (nd > 14) ? nd : 14;
+  if (x < -4 || x >= prec) {  /* exponential notation */
+    int ex = (x < 0) ? -x : x;
+    *p++ = digits[0];
+    if (nd > 1) {
+      *p++ = '.';
+      for (i = 1; i < nd; i++) *p++ = digits[i];
+    }
+    *p++ = 'e';
+    *p++ = (x < 0) ? '-' : '+';
+    if (ex >= 100) { *p++ = cast(char, '0' + ex / 100); ex %= 100; }
+    *p++ = cast(char, '0' + ex / 10);
+    *p++ = cast(char, '0' + ex % 10);
+  }
+  else if (x >= 0) {  /* integral part has x + 1 digits */
+    for (i = 0; i <= x; i++) *p++ = (i < nd) ? digits[i] : '0';
+    if (nd > x + 1) {
+      *p++ = '.';
+      for (; i < nd; i++) *p++ = digits[i];
+    }
+  }
+  else {  /* 0.000ddd */
+    *p++ = '0';
+    *p++ = '.';
+    for (i = x + 1; i < 0; i++) *p++ = '0';
+    for (i = 0; i < nd; i++) *p++ = digits[i];
+  }
+  *p = '\0';
+  return cast_int(p - s);
+}
+
+
+
+#if defined(L_EXACTSCALE)
+
+/*
+** convert the whole of [s, e) as a decimal numeral with Clinger's fast
+** path: at most 19 significant digits, with a mantissa and a power of
+** ten that are both exact doubles.  Returns 0 when the numeral is
+** invalid or off the fast path, leaving the decision to the general code.
+*/
+static int l_str2dfast (const char *s, const char *e, lua_Number *result) {
+  l_uint64 m = 0;
+  int nd = 0;  /* significant digits in 'm' */
+  int exp = 0;  /* decimal exponent to apply to 'm' */
+  int any = 0;  /* read any digit? */
+  int neg = 0;
+  while (lisspace(cast_uchar(*s))) s++;
+  if (*s == '-') { s++; neg = 1; }
+  else if (*s == '+') s++;
+  for (; lisdigit(cast_uchar(*s)); s++) {
+    int d = *s - '0';
+    any = 1;
+    if (nd < 19) {
+      m = m * 10 + d;
+      if (m != 0) nd++;
+    }
+    else if (d != 0) return 0;  /* too many significant digits */
+    else exp++;
+  }
+  if (*s == '.') {
+    for (s++; lisdigit(cast_uchar(*s)); s++) {
+      int d = *s - '0';
+      any = 1;
+      if (nd < 19) {
+        m = m * 10 + d;
+        if (m != 0) nd++;
+        exp--;
+      }
+      else if (d != 0) return 0;
+    }
+  }
+  if (!any) return 0;
+  if (*s == 'e' || *s == 'E') {
+    int eneg = 0, ex = 0;
+    s++;
+    if (*s == '-') { s++; eneg = 1; }
+    else if (*s == '+') s++;
+    if (!lisdigit(cast_uchar(*s))) return 0;
+    for (; lisdigit(cast_uchar(*s)); s++)
+      if (ex < 10000) ex = ex * 10 + (*s - '0');
+    exp += eneg ? -ex : ex;
+  }
+  while (lisspace(cast_uchar(*s))) s++;
+  if (s != e) return 0;  /* trailing characters (or an embedded '\0') */
+  if (m == 0)
+    *result = 0;
+  else if (m <= (DBL_HIDDEN << 1) && -22 <= exp && exp <= 22) {
+    lua_Number r = cast_num(m);
+    *result = (exp < 0) ? r / pow10d[-exp] : r * pow10d[exp];
+  }
+  else return 0;
+  if (neg) *result = -*result;
+  return 1;
+}
+
+#endif
+
+#else			/* }{ */
+
+int luaO_num2str (char *s, lua_Number n) {
+  return lua_number2str(s, n);
+}
+
+#endif			/* } */
+
+
+/*
+** convert an integer to a decimal numeral in 's'; returns the length
+*/
+int luaO_int2str (char *s, lua_Integer i) {
+  char buff[3 * sizeof(lua_Integer) + 2];
+  char *b = buff + sizeof(buff);
+  lu_integer u = (i < 0) ? 0u - cast(lu_integer, i) : cast(lu_integer, i);
+  int l;
+  do { *--b = cast(char, '0' + u % 10); u /= 10; } while (u != 0);
+  if (i < 0) *--b = '-';
+  l = cast_int(buff + sizeof(buff) - b);
+  memcpy(s, b, l);
+  s[l] = '\0';
+  return l;
+}
+
+/* }====================================================== */
+
+
 int luaO_str2d (const char *s, size_t len, lua_Number *result) {
   char *endptr;
+#if defined(L_EXACTSCALE)
+  if (l_str2dfast(s, s + len, result))
+    return 1;
+#endif
   if (strpbrk(s, "nN"))  /* reject 'inf' and 'nan' */
     return 0;
   else if (strpbrk(s, "xX"))  /* hexa? */
@@ -169,6 +642,47 @@ int luaO_str2d (const char *s, size_t len, lua_Number *result) {
 }
 
 
+/*
+** convert a decimal or hexadecimal integer numeral to a lua_Integer.
+** Fails for anything that is not an integer numeral and for values that
+** do not fit in a lua_Integer (those are read as floats instead).
+*/
+int luaO_str2int (const char *s, size_t len, lua_Integer *result) {
+  const char *e = s + len;
+  lu_integer a = 0;
+  lu_integer lim;  /* maximum absolute value allowed */
+  int empty = 1;
+  int neg;
+  while (lisspace(cast_uchar(*s))) s++;  /* skip initial spaces */
+  neg = (*s == '-');
+  if (*s == '-' || *s == '+') s++;
+  lim = cast(lu_integer, MAX_LUAINTEGER) + neg;
+  if (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) {  /* hexadecimal? */
+    s += 2;  /* skip '0x' */
+    for (; lisxdigit(cast_uchar(*s)); s++) {
+      int d = luaO_hexavalue(cast_uchar(*s));
+      if (a > (lim - d) / 16) return 0;  /* overflow */
+      a = a * 16 + d;
+      empty = 0;
+    }
+  }
+  else {  /* decimal */
+    for (; lisdigit(cast_uchar(*s)); s++) {
+      int d = *s - '0';
+      if (a > (lim - d) / 10) return 0;  /* overflow */
+      a = a * 10 + d;
+      empty = 0;
+    }
+  }
+  while (lisspace(cast_uchar(*s))) s++;  /* skip trailing spaces */
+  if (empty || s != e) return 0;  /* something wrong in the numeral */
+  if (neg && a == 0) return 0;  /* '-0' is the float -0 */
+  *result = cast(lua_Integer, neg ? 0u - a : a);
+  return 1;
+}
+
+
+
 
 static void pushstr (lua_State *L, const char *str, size_t l) {
   setsvalue2s(L, L->top++, luaS_newlstr(L, str, l));
@@ -197,7 +711,7 @@ const char *luaO_pushvfstring (lua_State *L, const char *fmt, va_list argp) {
         break;
       }
       case 'd': {
-        setnvalue(L->top++, cast_num(va_arg(argp, int)));
+        setivalue(L->top++, va_arg(argp, int));
         break;
       }
       case 'f': {
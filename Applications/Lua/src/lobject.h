@@ -57,6 +57,20 @@
 #define LUA_TLNGSTR	(LUA_TSTRING | (1 << 4))  /* long strings */
 
 
+/*
+** LUA_TNUMBER variants:
+** 0 - float (lua_Number)
+** 1 - integer (lua_Integer)
+** Both are the same Lua type; integers only keep exact values that fit
+** in a lua_Integer, and operations that cannot be done exactly on them
+** produce floats.
+*/
+
+/* Variant tags for numbers */
+#define LUA_TNUMFLT	(LUA_TNUMBER | (0 << 4))  /* float numbers */
+#define LUA_TNUMINT	(LUA_TNUMBER | (1 << 4))  /* integer numbers */
+
+
 /* Bit mark for collectable types */
 #define BIT_ISCOLLECTABLE	(1 << 6)
 
@@ -92,7 +106,7 @@ typedef struct GCheader {
 typedef union Value Value;
 
 
-#define numfield	lua_Number n;    /* numbers */
+#define numfield	lua_Number n;    /* float numbers */
 
 
 
@@ -112,6 +126,7 @@ typedef struct lua_TValue TValue;
 
 #define val_(o)		((o)->value_)
 #define num_(o)		(val_(o).n)
+#define int_(o)		(val_(o).i)
 
 
 /* raw type tag of a TValue */
@@ -130,7 +145,9 @@ typedef struct lua_TValue TValue;
 /* Macros to test type */
 #define checktag(o,t)		(rttype(o) == (t))
 #define checktype(o,t)		(ttypenv(o) == (t))
-#define ttisnumber(o)		checktag((o), LUA_TNUMBER)
+#define ttisnumber(o)		checktype((o), LUA_TNUMBER)
+#define ttisfloat(o)		checktag((o), LUA_TNUMFLT)
+#define ttisinteger(o)		checktag((o), LUA_TNUMINT)
 #define ttisnil(o)		checktag((o), LUA_TNIL)
 #define ttisboolean(o)		checktag((o), LUA_TBOOLEAN)
 #define ttislightuserdata(o)	checktag((o), LUA_TLIGHTUSERDATA)
@@ -150,7 +167,11 @@ typedef struct lua_TValue TValue;
 #define ttisequal(o1,o2)	(rttype(o1) == rttype(o2))
 
 /* Macros to access values */
-#define nvalue(o)	check_exp(ttisnumber(o), num_(o))
+#define fltvalue(o)	check_exp(ttisfloat(o), num_(o))
+#define ivalue(o)	check_exp(ttisinteger(o), int_(o))
+/* value of any number as a lua_Number */
+#define nvalue(o)	check_exp(ttisnumber(o), \
+	(ttisinteger(o) ? cast_num(int_(o)) : num_(o)))
 #define gcvalue(o)	check_exp(iscollectable(o), val_(o).gc)
 #define pvalue(o)	check_exp(ttislightuserdata(o), val_(o).p)
 #define rawtsvalue(o)	check_exp(ttisstring(o), &val_(o).gc->ts)
@@ -185,7 +206,10 @@ typedef struct lua_TValue TValue;
 #define settt_(o,t)	((o)->tt_=(t))
 
 #define setnvalue(obj,x) \
-  { TValue *io=(obj); num_(io)=(x); settt_(io, LUA_TNUMBER); }
+  { TValue *io=(obj); num_(io)=(x); settt_(io, LUA_TNUMFLT); }
+
+#define setivalue(obj,x) \
+  { TValue *io=(obj); int_(io)=(x); settt_(io, LUA_TNUMINT); }
 
 #define setnilvalue(obj) settt_(obj, LUA_TNIL)
 
@@ -275,8 +299,9 @@ typedef struct lua_TValue TValue;
 #if defined(LUA_NANTRICK)
 
 /*
-** numbers are represented in the 'd_' field. All other values have the
-** value (NNMARK | tag) in 'tt__'. A number with such pattern would be
+** float numbers are represented in the 'd_' field. All other values
+** (including integer numbers, which must fit in a 'Value') have the
+** value (NNMARK | tag) in 'tt__'. A float with such pattern would be
 ** a "signaled NaN", which is never generated by regular operations by
 ** the CPU (nor by 'strtod')
 */
@@ -333,21 +358,24 @@ typedef struct lua_TValue TValue;
 #undef numfield
 #define numfield	/* no such field; numbers are the entire struct */
 
-/* basic check to distinguish numbers from non-numbers */
+/* basic check to distinguish floats from other values */
+#undef ttisfloat
+#define ttisfloat(o)	((tt_(o) & NNMASK) != NNMARK)
+
 #undef ttisnumber
-#define ttisnumber(o)	((tt_(o) & NNMASK) != NNMARK)
+#define ttisnumber(o)	(ttisfloat(o) || ttisinteger(o))
 
 #define tag2tt(t)	(NNMARK | (t))
 
 #undef rttype
-#define rttype(o)	(ttisnumber(o) ? LUA_TNUMBER : tt_(o) & 0xff)
+#define rttype(o)	(ttisfloat(o) ? LUA_TNUMFLT : tt_(o) & 0xff)
 
 #undef settt_
 #define settt_(o,t)	(tt_(o) = tag2tt(t))
 
 #undef setnvalue
 #define setnvalue(obj,x) \
-	{ TValue *io_=(obj); num_(io_)=(x); lua_assert(ttisnumber(io_)); }
+	{ TValue *io_=(obj); num_(io_)=(x); lua_assert(ttisfloat(io_)); }
 
 #undef setobj
 #define setobj(L,obj1,obj2) \
@@ -367,7 +395,7 @@ typedef struct lua_TValue TValue;
 
 #undef ttisequal
 #define ttisequal(o1,o2)  \
-	(ttisnumber(o1) ? ttisnumber(o2) : (tt_(o1) == tt_(o2)))
+	(ttisfloat(o1) ? ttisfloat(o2) : (tt_(o1) == tt_(o2)))
 
 
 #undef luai_checknum
@@ -390,7 +418,8 @@ union Value {
   void *p;         /* light userdata */
   int b;           /* booleans */
   lua_CFunction f; /* light C functions */
-  numfield         /* numbers */
+  lua_Integer i;   /* integer numbers */
+  numfield         /* float numbers */
 };
 
 
@@ -461,6 +490,16 @@ typedef struct LocVar {
 } LocVar;
 
 
+/*
+** Inline cache for table accesses with a constant short-string key:
+** remembers the node array and slot where the key was last found
+*/
+typedef struct ICache {
+  struct Node *node;  /* node array of the table last searched */
+  unsigned int slot;  /* index of the key in 'node' */
+} ICache;
+
+
 /*
 ** Function Prototypes
 */
@@ -473,10 +512,12 @@ typedef struct Proto {
   LocVar *locvars;  /* information about local variables (debug information) */
   Upvaldesc *upvalues;  /* upvalue information */
   union Closure *cache;  /* last created closure with this prototype */
+  ICache *icache;  /* inline caches, indexed by pc (or NULL) */
   TString  *source;  /* used for debug information */
   int sizeupvalues;  /* size of 'upvalues' */
   int sizek;  /* size of `k' */
   int sizecode;
+  int sizeicache;  /* size of 'icache' (0 or 'sizecode') */
   int sizelineinfo;
   int sizep;  /* size of `p' */
   int sizelocvars;
@@ -545,7 +586,7 @@ typedef union Closure {
 typedef union TKey {
   struct {
     TValuefields;
-    struct Node *next;  /* for chaining */
+    int next;  /* offset to next node of the chain (0 if none) */
   } nk;
   TValue tvk;
 } TKey;
@@ -565,8 +606,11 @@ typedef struct Table {
   TValue *array;  /* array part */
   Node *node;
   Node *lastfree;  /* any free position is before this position */
+  Node *oldnode;  /* hash part being migrated (incremental rehash) */
   GCObject *gclist;
   int sizearray;  /* size of `array' array */
+  int nextold;  /* nodes of `oldnode' below this one are still to move */
+  lu_byte lsizeold;  /* log2 of size of `oldnode' array */
 } Table;
 
 
@@ -580,6 +624,7 @@ typedef struct Table {
 
 #define twoto(x)	(1<<(x))
 #define sizenode(t)	(twoto((t)->lsizenode))
+#define sizeoldnode(t)	(twoto((t)->lsizeold))
 
 
 /*
@@ -595,7 +640,14 @@ LUAI_FUNC int luaO_int2fb (unsigned int x);
 LUAI_FUNC int luaO_fb2int (int x);
 LUAI_FUNC int luaO_ceillog2 (unsigned int x);
 LUAI_FUNC lua_Number luaO_arith (int op, lua_Number v1, lua_Number v2);
+LUAI_FUNC int luaO_intarith (int op, lua_Integer v1, lua_Integer v2,
+                             lua_Integer *res);
+LUAI_FUNC void luaO_arithnum (int op, const TValue *p1, const TValue *p2,
+                              TValue *res);
+LUAI_FUNC int luaO_num2str (char *s, lua_Number n);
+LUAI_FUNC int luaO_int2str (char *s, lua_Integer i);
 LUAI_FUNC int luaO_str2d (const char *s, size_t len, lua_Number *result);
+LUAI_FUNC int luaO_str2int (const char *s, size_t len, lua_Integer *result);
 LUAI_FUNC int luaO_hexavalue (int c);
 LUAI_FUNC const char *luaO_pushvfstring (lua_State *L, const char *fmt,
                                                        va_list argp);
@@ -38,6 +38,10 @@
 #define LUAI_GCMUL	200 /* GC runs 'twice the speed' of memory allocation */
 #endif
 
+#if !defined(LUAI_GCSTEPTIME)
+#define LUAI_GCSTEPTIME	0  /* steps measured in work units */
+#endif
+
 
 #define MEMERRMSG	"not enough memory"
 
@@ -286,6 +290,8 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->gcrunning = 0;  /* no GC while building state */
   g->GCestimate = 0;
   g->strt.size = 0;
+  g->strt.oldsize = 0;
+  g->strt.split = 0;
   g->strt.nuse = 0;
   g->strt.hash = NULL;
   setnilvalue(&g->l_registry);
@@ -299,11 +305,19 @@ LUA_API lua_State *lua_newstate (lua_Alloc f, void *ud) {
   g->sweepgc = g->sweepfin = NULL;
   g->gray = g->grayagain = NULL;
   g->weak = g->ephemeron = g->allweak = NULL;
+  g->ephdeps = NULL;
+  memset(&g->gcstats, 0, sizeof(g->gcstats));
+  g->gcclock = 0;
   g->totalbytes = sizeof(LG);
   g->GCdebt = 0;
+  g->memlimit = 0;
+  g->mempeak = sizeof(LG);
+  g->lowmem = NULL;
+  g->lowmemud = NULL;
   g->gcpause = LUAI_GCPAUSE;
   g->gcmajorinc = LUAI_GCMAJOR;
   g->gcstepmul = LUAI_GCMUL;
+  g->gcsteptime = LUAI_GCSTEPTIME;
   for (i=0; i < LUA_NUMTAGS; i++) g->mt[i] = NULL;
   if (luaD_rawrunprotected(L, f_luaopen, NULL) != LUA_OK) {
     /* memory allocation error: free partial state */
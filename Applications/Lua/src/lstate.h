@@ -60,6 +60,8 @@ typedef struct stringtable {
   GCObject **hash;
   lu_int32 nuse;  /* number of elements */
   int size;
+  int oldsize;  /* size before a growth still being spread (0 if none) */
+  int split;  /* next old bucket to spread into the new half */
 } stringtable;
 
 
@@ -133,12 +135,20 @@ typedef struct global_State {
   GCObject *weak;  /* list of tables with weak values */
   GCObject *ephemeron;  /* list of ephemeron tables (weak keys) */
   GCObject *allweak;  /* list of all-weak tables */
+  struct EphDeps *ephdeps;  /* pending ephemeron entries (while converging) */
+  lu_mem memlimit;  /* maximum number of bytes in use (0 means no limit) */
+  lu_mem mempeak;  /* largest number of bytes in use */
+  lua_LowMemory lowmem;  /* called when memory runs out */
+  void *lowmemud;  /* auxiliary data to 'lowmem' */
+  lua_GCStats gcstats;  /* collector statistics */
+  lua_Number gcclock;  /* last time collector work was accounted for */
   GCObject *tobefnz;  /* list of userdata to be GC */
   UpVal uvhead;  /* head of double-linked list of all open upvalues */
   Mbuffer buff;  /* temporary buffer for string concatenation */
   int gcpause;  /* size of pause between successive GCs */
   int gcmajorinc;  /* pause between major collections (only in gen. mode) */
   int gcstepmul;  /* GC `granularity' */
+  int gcsteptime;  /* time budget of each step, in us (0 means none) */
   lua_CFunction panic;  /* to be called in unprotected errors */
   struct lua_State *mainthread;
   const lua_Number *version;  /* pointer to version number */
@@ -19,14 +19,24 @@
 
 
 /*
-** Lua will use at most ~(2^LUAI_HASHLIMIT) bytes from a string to
-** compute its hash
+** Lua will use at most ~(2^LUAI_HASHLIMIT) bytes from a long string to
+** compute its hash (short strings are hashed whole)
 */
 #if !defined(LUAI_HASHLIMIT)
 #define LUAI_HASHLIMIT		5
 #endif
 
 
+/*
+** number of old buckets spread into the new half of a growing string
+** table at each string creation (must be at least 2, so that a growth
+** always ends before the table fills up again)
+*/
+#if !defined(LUAI_STRSPLITSTEP)
+#define LUAI_STRSPLITSTEP	4
+#endif
+
+
 /*
 ** equality for long strings
 */
@@ -48,13 +58,94 @@ int luaS_eqstr (TString *a, TString *b) {
 }
 
 
+#define rotl32(x,n)	(((x) << (n)) | ((x) >> (32 - (n))))
+
+/* mixes a 32-bit word into 'h' (MurmurHash3 round) */
+#define hashword(h,w)  { lu_int32 k_ = (w) * 0xCC9E2D51u; \
+	k_ = rotl32(k_, 15) * 0x1B873593u; \
+	h ^= k_; h = rotl32(h, 13) * 5 + 0xE6546B64u; }
+
+
+/*
+** Short strings are hashed whole, one 32-bit word at a time, as many
+** of them share long prefixes; long strings (hashed only when used as
+** keys) sample at most ~(2^LUAI_HASHLIMIT) characters.
+*/
 unsigned int luaS_hash (const char *str, size_t l, unsigned int seed) {
-  unsigned int h = seed ^ cast(unsigned int, l);
-  size_t l1;
-  size_t step = (l >> LUAI_HASHLIMIT) + 1;
-  for (l1 = l; l1 >= step; l1 -= step)
-    h = h ^ ((h<<5) + (h>>2) + cast_byte(str[l1 - 1]));
-  return h;
+  if (l <= LUAI_MAXSHORTLEN) {
+    lu_int32 h = seed ^ cast(lu_int32, l);
+    lu_int32 w;
+    for (; l >= sizeof(w); l -= sizeof(w), str += sizeof(w)) {
+      memcpy(&w, str, sizeof(w));
+      hashword(h, w);
+    }
+    if (l > 0) {  /* last partial word */
+      w = 0;
+      memcpy(&w, str, l);
+      hashword(h, w);
+    }
+    h ^= h >> 16; h *= 0x85EBCA6Bu;  /* final avalanche */
+    h ^= h >> 13; h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return cast(unsigned int, h);
+  }
+  else {
+    unsigned int h = seed ^ cast(unsigned int, l);
+    size_t l1;
+    size_t step = (l >> LUAI_HASHLIMIT) + 1;
+    for (l1 = l; l1 >= step; l1 -= step)
+      h = h ^ ((h<<5) + (h>>2) + cast_byte(str[l1 - 1]));
+    return h;
+  }
+}
+
+
+/*
+** While the string table grows, old bucket 'i' is still unsplit (its
+** strings not yet spread between 'i' and 'i + oldsize') for i >= split.
+*/
+static GCObject **strbucket (stringtable *tb, unsigned int h) {
+  int i = lmod(h, tb->size);
+  if (tb->oldsize > 0 && lmod(i, tb->oldsize) >= tb->split)
+    i = lmod(i, tb->oldsize);
+  return &tb->hash[i];
+}
+
+
+/*
+** spreads up to 'n' unsplit old buckets; strings only move to higher
+** buckets, so none escapes a sweep of the string table in progress
+*/
+static void splitbuckets (stringtable *tb, int n) {
+  for (; n > 0 && tb->oldsize > 0; n--) {
+    GCObject *p = tb->hash[tb->split];
+    tb->hash[tb->split] = NULL;
+    while (p) {  /* for each node in the list */
+      GCObject *next = gch(p)->next;  /* save next */
+      GCObject **list = &tb->hash[lmod(gco2ts(p)->hash, tb->size)];
+      gch(p)->next = *list;  /* chain it */
+      *list = p;
+      resetoldbit(p);  /* see MOVE OLD rule */
+      p = next;
+    }
+    if (++tb->split == tb->oldsize)  /* all old buckets split? */
+      tb->oldsize = tb->split = 0;
+  }
+}
+
+
+/*
+** doubles the string table; its strings are spread into the new half
+** a few buckets at a time, as new strings are created
+*/
+static void growstrtab (lua_State *L, stringtable *tb) {
+  int i, size = tb->size;
+  splitbuckets(tb, MAX_INT);  /* finish previous growth */
+  luaM_reallocvector(L, tb->hash, size, size*2, GCObject *);
+  for (i = size; i < size*2; i++) tb->hash[i] = NULL;
+  tb->size = size*2;
+  tb->oldsize = size;
+  tb->split = 0;
 }
 
 
@@ -66,6 +157,7 @@ void luaS_resize (lua_State *L, int newsize) {
   stringtable *tb = &G(L)->strt;
   /* cannot resize while GC is traversing strings */
   luaC_runtilstate(L, ~bitmask(GCSsweepstring));
+  splitbuckets(tb, MAX_INT);  /* finish a growth in progress */
   if (newsize > tb->size) {
     luaM_reallocvector(L, tb->hash, tb->size, newsize, GCObject *);
     for (i = tb->size; i < newsize; i++) tb->hash[i] = NULL;
@@ -104,7 +196,8 @@ static TString *createstrobj (lua_State *L, const char *str, size_t l,
   ts->tsv.len = l;
   ts->tsv.hash = h;
   ts->tsv.extra = 0;
-  memcpy(ts+1, str, l*sizeof(char));
+  if (str != NULL)
+    memcpy(ts+1, str, l*sizeof(char));
   ((char *)(ts+1))[l] = '\0';  /* ending 0 */
   return ts;
 }
@@ -119,8 +212,10 @@ static TString *newshrstr (lua_State *L, const char *str, size_t l,
   stringtable *tb = &G(L)->strt;
   TString *s;
   if (tb->nuse >= cast(lu_int32, tb->size) && tb->size <= MAX_INT/2)
-    luaS_resize(L, tb->size*2);  /* too crowded */
-  list = &tb->hash[lmod(h, tb->size)];
+    growstrtab(L, tb);  /* too crowded */
+  else
+    splitbuckets(tb, LUAI_STRSPLITSTEP);
+  list = strbucket(tb, h);
   s = createstrobj(L, str, l, LUA_TSHRSTR, h, list);
   tb->nuse++;
   return s;
@@ -134,7 +229,7 @@ static TString *internshrstr (lua_State *L, const char *str, size_t l) {
   GCObject *o;
   global_State *g = G(L);
   unsigned int h = luaS_hash(str, l, g->seed);
-  for (o = g->strt.hash[lmod(h, g->strt.size)];
+  for (o = *strbucket(&g->strt, h);
        o != NULL;
        o = gch(o)->next) {
     TString *ts = rawgco2ts(o);
@@ -164,6 +259,18 @@ TString *luaS_newlstr (lua_State *L, const char *str, size_t l) {
 }
 
 
+/*
+** new long string with room for 'l' chars, to be filled by the caller
+** before it is used
+*/
+TString *luaS_newlngstr (lua_State *L, size_t l) {
+  lua_assert(l > LUAI_MAXSHORTLEN);
+  if (l + 1 > (MAX_SIZET - sizeof(TString))/sizeof(char))
+    luaM_toobig(L);
+  return createstrobj(L, NULL, l, LUA_TLNGSTR, G(L)->seed, NULL);
+}
+
+
 /*
 ** new zero-terminated string
 */
@@ -40,6 +40,7 @@ LUAI_FUNC int luaS_eqstr (TString *a, TString *b);
 LUAI_FUNC void luaS_resize (lua_State *L, int newsize);
 LUAI_FUNC Udata *luaS_newudata (lua_State *L, size_t s, Table *e);
 LUAI_FUNC TString *luaS_newlstr (lua_State *L, const char *str, size_t l);
+LUAI_FUNC TString *luaS_newlngstr (lua_State *L, size_t l);
 LUAI_FUNC TString *luaS_new (lua_State *L, const char *str);
 
 
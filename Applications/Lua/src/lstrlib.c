@@ -6,6 +6,7 @@
 
 
 #include <ctype.h>
+#include <limits.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -29,6 +30,15 @@
 #endif
 
 
+/*
+** number of compiled patterns kept by the pattern cache; when it is
+** full, it is emptied
+*/
+#if !defined(LUA_PATCACHESIZE)
+#define LUA_PATCACHESIZE  32
+#endif
+
+
 /* macro to `unsign' a character */
 #define uchar(c)  ((unsigned char)(c))
 
@@ -195,11 +205,50 @@ static int str_dump (lua_State *L) {
 #define CAP_POSITION  (-2)
 
 
+/*
+** Patterns are compiled into a sequence of items, one for each pattern
+** element; single-char classes become a set of 256 bits.
+*/
+#define PI_SET		0	/* single-char class, with optional suffix */
+#define PI_OPEN		1	/* `(' */
+#define PI_POSITION	2	/* `()' */
+#define PI_CLOSE	3	/* `)' */
+#define PI_EOS		4	/* `$' at the end of the pattern */
+#define PI_BALANCE	5	/* `%bxy' */
+#define PI_FRONTIER	6	/* `%f[set]' */
+#define PI_BACKREF	7	/* `%1' ... `%9' */
+
+#define CHARSETSIZE	(UCHAR_MAX/CHAR_BIT + 1)
+#define inset(set,c)	((set)[uchar(c) / CHAR_BIT] & (1 << (uchar(c) % CHAR_BIT)))
+
+typedef struct PatItem {
+  unsigned char op;
+  char rep;  /* suffix (`*', `+', `-' or `?') of a PI_SET, or 0 */
+  char arg[2];  /* delimiters of a PI_BALANCE, capture of a PI_BACKREF */
+  unsigned char set[CHARSETSIZE];  /* for PI_SET and PI_FRONTIER */
+} PatItem;
+
+
+/* maximum length of the literal prefix of a compiled pattern */
+#define MAXPREFIX	32
+
+typedef struct CPattern {
+  int anchor;  /* pattern starts with `^'? */
+  int nitems;
+  size_t lprefix;  /* length of the literal text all matches start with */
+  char prefix[MAXPREFIX];
+  int hasfirst;  /* is `first' the set of chars a match can start with? */
+  unsigned char first[CHARSETSIZE];
+  PatItem item[1];
+} CPattern;
+
+
 typedef struct MatchState {
   int matchdepth;  /* control for recursive depth (to avoid C stack overflow) */
   const char *src_init;  /* init of source string */
   const char *src_end;  /* end ('\0') of source string */
-  const char *p_end;  /* end ('\0') of pattern */
+  const char *p_end;  /* end ('\0') of pattern (while compiling it) */
+  const PatItem *pi_end;  /* end of compiled pattern */
   lua_State *L;
   int level;  /* total number of captures (finished or unfinished) */
   struct {
@@ -210,7 +259,7 @@ typedef struct MatchState {
 
 
 /* recursive function */
-static const char *match (MatchState *ms, const char *s, const char *p);
+static const char *match (MatchState *ms, const char *s, const PatItem *pi);
 
 
 /* maximum recursion depth for 'match' */
@@ -306,31 +355,15 @@ static int matchbracketclass (int c, const char *p, const char *ec) {
 }
 
 
-static int singlematch (MatchState *ms, const char *s, const char *p,
-                        const char *ep) {
-  if (s >= ms->src_end)
-    return 0;
-  else {
-    int c = uchar(*s);
-    switch (*p) {
-      case '.': return 1;  /* matches any char */
-      case L_ESC: return match_class(c, uchar(*(p+1)));
-      case '[': return matchbracketclass(c, p, ep-1);
-      default:  return (uchar(*p) == c);
-    }
-  }
-}
+#define singlematch(ms,s,pi)	((s) < (ms)->src_end && inset((pi)->set, *(s)))
 
 
 static const char *matchbalance (MatchState *ms, const char *s,
-                                   const char *p) {
-  if (p >= ms->p_end - 1)
-    luaL_error(ms->L, "malformed pattern "
-                      "(missing arguments to " LUA_QL("%%b") ")");
-  if (*s != *p) return NULL;
+                                   const PatItem *pi) {
+  if (*s != pi->arg[0]) return NULL;
   else {
-    int b = *p;
-    int e = *(p+1);
+    int b = pi->arg[0];
+    int e = pi->arg[1];
     int cont = 1;
     while (++s < ms->src_end) {
       if (*s == e) {
@@ -344,13 +377,13 @@ static const char *matchbalance (MatchState *ms, const char *s,
 
 
 static const char *max_expand (MatchState *ms, const char *s,
-                                 const char *p, const char *ep) {
+                                 const PatItem *pi) {
   ptrdiff_t i = 0;  /* counts maximum expand for item */
-  while (singlematch(ms, s + i, p, ep))
+  while (singlematch(ms, s + i, pi))
     i++;
   /* keeps trying to match with the maximum repetitions */
   while (i>=0) {
-    const char *res = match(ms, (s+i), ep+1);
+    const char *res = match(ms, (s+i), pi+1);
     if (res) return res;
     i--;  /* else didn't match; reduce 1 repetition to try again */
   }
@@ -359,12 +392,12 @@ static const char *max_expand (MatchState *ms, const char *s,
 
 
 static const char *min_expand (MatchState *ms, const char *s,
-                                 const char *p, const char *ep) {
+                                 const PatItem *pi) {
   for (;;) {
-    const char *res = match(ms, s, ep+1);
+    const char *res = match(ms, s, pi+1);
     if (res != NULL)
       return res;
-    else if (singlematch(ms, s, p, ep))
+    else if (singlematch(ms, s, pi))
       s++;  /* try with one more repetition */
     else return NULL;
   }
@@ -372,25 +405,25 @@ static const char *min_expand (MatchState *ms, const char *s,
 
 
 static const char *start_capture (MatchState *ms, const char *s,
-                                    const char *p, int what) {
+                                    const PatItem *pi, int what) {
   const char *res;
   int level = ms->level;
   if (level >= LUA_MAXCAPTURES) luaL_error(ms->L, "too many captures");
   ms->capture[level].init = s;
   ms->capture[level].len = what;
   ms->level = level+1;
-  if ((res=match(ms, s, p)) == NULL)  /* match failed? */
+  if ((res=match(ms, s, pi)) == NULL)  /* match failed? */
     ms->level--;  /* undo capture */
   return res;
 }
 
 
 static const char *end_capture (MatchState *ms, const char *s,
-                                  const char *p) {
+                                  const PatItem *pi) {
   int l = capture_to_close(ms);
   const char *res;
   ms->capture[l].len = s - ms->capture[l].init;  /* close capture */
-  if ((res = match(ms, s, p)) == NULL)  /* match failed? */
+  if ((res = match(ms, s, pi)) == NULL)  /* match failed? */
     ms->capture[l].len = CAP_UNFINISHED;  /* undo capture */
   return res;
 }
@@ -407,84 +440,67 @@ static const char *match_capture (MatchState *ms, const char *s, int l) {
 }
 
 
-static const char *match (MatchState *ms, const char *s, const char *p) {
+static const char *match (MatchState *ms, const char *s, const PatItem *pi) {
   if (ms->matchdepth-- == 0)
     luaL_error(ms->L, "pattern too complex");
   init: /* using goto's to optimize tail recursion */
-  if (p != ms->p_end) {  /* end of pattern? */
-    switch (*p) {
-      case '(': {  /* start capture */
-        if (*(p + 1) == ')')  /* position capture? */
-          s = start_capture(ms, s, p + 2, CAP_POSITION);
-        else
-          s = start_capture(ms, s, p + 1, CAP_UNFINISHED);
+  if (pi != ms->pi_end) {  /* end of pattern? */
+    switch (pi->op) {
+      case PI_OPEN: {  /* start capture */
+        s = start_capture(ms, s, pi + 1, CAP_UNFINISHED);
         break;
       }
-      case ')': {  /* end capture */
-        s = end_capture(ms, s, p + 1);
+      case PI_POSITION: {  /* position capture */
+        s = start_capture(ms, s, pi + 1, CAP_POSITION);
         break;
       }
-      case '$': {
-        if ((p + 1) != ms->p_end)  /* is the `$' the last char in pattern? */
-          goto dflt;  /* no; go to default */
+      case PI_CLOSE: {  /* end capture */
+        s = end_capture(ms, s, pi + 1);
+        break;
+      }
+      case PI_EOS: {
         s = (s == ms->src_end) ? s : NULL;  /* check end of string */
         break;
       }
-      case L_ESC: {  /* escaped sequences not in the format class[*+?-]? */
-        switch (*(p + 1)) {
-          case 'b': {  /* balanced string? */
-            s = matchbalance(ms, s, p + 2);
-            if (s != NULL) {
-              p += 4; goto init;  /* return match(ms, s, p + 4); */
-            }  /* else fail (s == NULL) */
-            break;
-          }
-          case 'f': {  /* frontier? */
-            const char *ep; char previous;
-            p += 2;
-            if (*p != '[')
-              luaL_error(ms->L, "missing " LUA_QL("[") " after "
-                                 LUA_QL("%%f") " in pattern");
-            ep = classend(ms, p);  /* points to what is next */
-            previous = (s == ms->src_init) ? '\0' : *(s - 1);
-            if (!matchbracketclass(uchar(previous), p, ep - 1) &&
-               matchbracketclass(uchar(*s), p, ep - 1)) {
-              p = ep; goto init;  /* return match(ms, s, ep); */
-            }
-            s = NULL;  /* match failed */
-            break;
-          }
-          case '0': case '1': case '2': case '3':
-          case '4': case '5': case '6': case '7':
-          case '8': case '9': {  /* capture results (%0-%9)? */
-            s = match_capture(ms, s, uchar(*(p + 1)));
-            if (s != NULL) {
-              p += 2; goto init;  /* return match(ms, s, p + 2) */
-            }
-            break;
-          }
-          default: goto dflt;
+      case PI_BALANCE: {  /* balanced string? */
+        s = matchbalance(ms, s, pi);
+        if (s != NULL) {
+          pi++; goto init;  /* return match(ms, s, pi + 1); */
+        }  /* else fail (s == NULL) */
+        break;
+      }
+      case PI_FRONTIER: {
+        char previous = (s == ms->src_init) ? '\0' : *(s - 1);
+        if (!inset(pi->set, previous) && inset(pi->set, *s)) {
+          pi++; goto init;  /* return match(ms, s, pi + 1); */
+        }
+        s = NULL;  /* match failed */
+        break;
+      }
+      case PI_BACKREF: {  /* capture results (%0-%9)? */
+        s = match_capture(ms, s, uchar(pi->arg[0]));
+        if (s != NULL) {
+          pi++; goto init;  /* return match(ms, s, pi + 1) */
         }
         break;
       }
-      default: dflt: {  /* pattern class plus optional suffix */
-        const char *ep = classend(ms, p);  /* points to optional suffix */
+      default: {  /* single-char class plus optional suffix */
         /* does not match at least once? */
-        if (!singlematch(ms, s, p, ep)) {
-          if (*ep == '*' || *ep == '?' || *ep == '-') {  /* accept empty? */
-            p = ep + 1; goto init;  /* return match(ms, s, ep + 1); */
+        if (!singlematch(ms, s, pi)) {
+          if (pi->rep == '*' || pi->rep == '?' || pi->rep == '-') {
+            pi++; goto init;  /* accept empty; return match(ms, s, pi + 1); */
           }
           else  /* '+' or no suffix */
             s = NULL;  /* fail */
         }
         else {  /* matched once */
-          switch (*ep) {  /* handle optional suffix */
+          switch (pi->rep) {  /* handle optional suffix */
             case '?': {  /* optional */
               const char *res;
-              if ((res = match(ms, s + 1, ep + 1)) != NULL)
+              if ((res = match(ms, s + 1, pi + 1)) != NULL)
                 s = res;
               else {
-                p = ep + 1; goto init;  /* else return match(ms, s, ep + 1); */
+                pi++; goto init;  /* else return match(ms, s, pi + 1); */
               }
               break;
             }
@@ -492,13 +508,13 @@ static const char *match (MatchState *ms, const char *s, const char *p) {
               s++;  /* 1 match already done */
               /* go through */
             case '*':  /* 0 or more repetitions */
-              s = max_expand(ms, s, p, ep);
+              s = max_expand(ms, s, pi);
               break;
             case '-':  /* 0 or more repetitions (minimum) */
-              s = min_expand(ms, s, p, ep);
+              s = min_expand(ms, s, pi);
               break;
             default:  /* no suffix */
-              s++; p = ep; goto init;  /* return match(ms, s + 1, ep); */
+              s++; pi++; goto init;  /* return match(ms, s + 1, pi + 1); */
           }
         }
         break;
@@ -510,29 +526,305 @@ static const char *match (MatchState *ms, const char *s, const char *p) {
 }
 
 
+/*
+** {======================================================
+** Pattern compilation
+** =======================================================
+*/
+
+
+/* fills 'set' with the chars matched by the single-char class at 'p' */
+static void buildset (unsigned char *set, const char *p, const char *ep) {
+  int c;
+  memset(set, 0, CHARSETSIZE);
+  for (c = 0; c <= UCHAR_MAX; c++) {
+    int res;
+    switch (*p) {
+      case '.': res = 1; break;  /* matches any char */
+      case L_ESC: res = match_class(c, uchar(*(p+1))); break;
+      case '[': res = matchbracketclass(c, p, ep-1); break;
+      default:  res = (uchar(*p) == c); break;
+    }
+    if (res) set[c / CHAR_BIT] |= 1 << (c % CHAR_BIT);
+  }
+}
+
+
+/*
+** parses the pattern at 'p' (after any anchor) into the items of 'cp';
+** with 'cp' NULL, only counts them. Returns the number of items.
+*/
+static int compileitems (MatchState *ms, const char *p, CPattern *cp) {
+  int n = 0;
+  while (p != ms->p_end) {
+    PatItem dummy;
+    PatItem *pi = (cp != NULL) ? &cp->item[n] : &dummy;
+    const char *ep;
+    n++;
+    pi->rep = 0;
+    switch (*p) {
+      case '(': {
+        if (*(p + 1) == ')') {  /* position capture? */
+          pi->op = PI_POSITION; p += 2;
+        }
+        else {
+          pi->op = PI_OPEN; p++;
+        }
+        continue;
+      }
+      case ')': {
+        pi->op = PI_CLOSE; p++;
+        continue;
+      }
+      case '$': {
+        if ((p + 1) != ms->p_end)  /* is the `$' the last char in pattern? */
+          break;  /* no; it is a single char */
+        pi->op = PI_EOS; p++;
+        continue;
+      }
+      case L_ESC: {
+        switch (*(p + 1)) {
+          case 'b': {  /* balanced string */
+            p += 2;
+            if (p >= ms->p_end - 1)
+              luaL_error(ms->L, "malformed pattern "
+                                "(missing arguments to " LUA_QL("%%b") ")");
+            pi->op = PI_BALANCE;
+            pi->arg[0] = *p; pi->arg[1] = *(p + 1);
+            p += 2;
+            continue;
+          }
+          case 'f': {  /* frontier */
+            p += 2;
+            if (*p != '[')
+              luaL_error(ms->L, "missing " LUA_QL("[") " after "
+                                 LUA_QL("%%f") " in pattern");
+            ep = classend(ms, p);
+            pi->op = PI_FRONTIER;
+            if (cp != NULL) buildset(pi->set, p, ep);
+            p = ep;
+            continue;
+          }
+          case '0': case '1': case '2': case '3':
+          case '4': case '5': case '6': case '7':
+          case '8': case '9': {  /* back reference */
+            pi->op = PI_BACKREF;
+            pi->arg[0] = *(p + 1);
+            p += 2;
+            continue;
+          }
+          default: break;  /* a class such as `%a' */
+        }
+        break;
+      }
+      default: break;
+    }
+    /* single-char class plus optional suffix */
+    ep = classend(ms, p);
+    pi->op = PI_SET;
+    if (cp != NULL) buildset(pi->set, p, ep);
+    if (*ep == '*' || *ep == '+' || *ep == '-' || *ep == '?')
+      pi->rep = *ep++;
+    p = ep;
+  }
+  return n;
+}
+
+
+/* returns the only char in the set of 'pi', or -1 */
+static int singlechar (const PatItem *pi) {
+  int c, found = -1;
+  for (c = 0; c <= UCHAR_MAX; c++) {
+    if (inset(pi->set, c)) {
+      if (found >= 0) return -1;
+      found = c;
+    }
+  }
+  return found;
+}
+
+
+/*
+** finds what every match must start with: the literal text of leading
+** plain chars and the set of possible first chars (unless the pattern
+** can match the empty string or starts with something else). Items that
+** consume nothing (captures) are skipped.
+*/
+static void analyze (CPattern *cp) {
+  int i, k, depth = 0, literal = 1;
+  cp->lprefix = 0;
+  cp->hasfirst = 0;
+  memset(cp->first, 0, CHARSETSIZE);
+  for (i = 0; i < cp->nitems; i++) {
+    const PatItem *pi = &cp->item[i];
+    switch (pi->op) {
+      case PI_OPEN: {
+        depth++;
+        continue;
+      }
+      case PI_POSITION: continue;
+      case PI_CLOSE: {
+        if (depth-- == 0) return;  /* invalid; leave it to the matcher */
+        continue;
+      }
+      case PI_SET: {
+        if (literal && cp->lprefix < MAXPREFIX &&
+            (pi->rep == 0 || pi->rep == '+')) {
+          int c = singlechar(pi);
+          if (c >= 0)
+            cp->prefix[cp->lprefix++] = (char)c;
+          if (c < 0 || pi->rep == '+') literal = 0;
+        }
+        else literal = 0;
+        if (!cp->hasfirst) {
+          for (k = 0; k < CHARSETSIZE; k++)
+            cp->first[k] |= pi->set[k];
+          if (pi->rep == 0 || pi->rep == '+')  /* cannot be skipped? */
+            cp->hasfirst = 1;
+        }
+        if (!literal && cp->hasfirst) return;
+        continue;
+      }
+      case PI_BALANCE: {
+        if (!cp->hasfirst) {
+          cp->first[uchar(pi->arg[0]) / CHAR_BIT] |=
+              1 << (uchar(pi->arg[0]) % CHAR_BIT);
+          cp->hasfirst = 1;
+        }
+        return;
+      }
+      default: return;  /* may match the empty string */
+    }
+  }
+}
+
+
+/*
+** compiles a pattern, leaving its compiled form on the stack; without
+** 'anchored', a leading `^' is a plain char (as in 'gmatch')
+*/
+static const CPattern *compile (lua_State *L, const char *p, size_t lp,
+                                int anchored) {
+  MatchState ms;
+  CPattern *cp;
+  int n;
+  int anchor = (anchored && *p == '^');
+  if (anchor) {
+    p++; lp--;  /* skip anchor character */
+  }
+  ms.L = L;
+  ms.p_end = p + lp;
+  n = compileitems(&ms, p, NULL);
+  cp = (CPattern *)lua_newuserdata(L, sizeof(CPattern) + n * sizeof(PatItem));
+  cp->anchor = anchor;
+  cp->nitems = compileitems(&ms, p, cp);
+  analyze(cp);
+  return cp;
+}
+
+
+/*
+** returns the compiled form of the pattern at index 'arg', looking it up
+** first in the cache (first upvalue); the compiled pattern is left on the
+** stack, so that it outlives any flush of the cache during the match
+*/
+static const CPattern *getpattern (lua_State *L, int arg) {
+  size_t lp;
+  const char *p = lua_tolstring(L, arg, &lp);
+  const CPattern *cp;
+  lua_Integer n;
+  lua_pushvalue(L, arg);
+  lua_rawget(L, lua_upvalueindex(1));
+  if ((cp = (const CPattern *)lua_touserdata(L, -1)) != NULL)
+    return cp;  /* cache hit */
+  lua_pop(L, 1);
+  cp = compile(L, p, lp, 1);
+  lua_rawgeti(L, lua_upvalueindex(1), 0);  /* number of entries */
+  n = lua_tointeger(L, -1);
+  lua_pop(L, 1);
+  if (n >= LUA_PATCACHESIZE) {  /* cache full? */
+    lua_cleartable(L, lua_upvalueindex(1));
+    n = 0;
+  }
+  lua_pushvalue(L, arg);
+  lua_pushvalue(L, -2);
+  lua_rawset(L, lua_upvalueindex(1));  /* cache[p] = cp */
+  lua_pushinteger(L, n + 1);
+  lua_rawseti(L, lua_upvalueindex(1), 0);
+  return cp;
+}
+
+/* }====================================================== */
+
+
+/*
+** 'lmemfind' switches from 'memchr' to a skip table once it has seen
+** MEMFIND_MISSES false candidates less than MEMFIND_GAP bytes apart on
+** average (in repetitive data, the first char is a poor filter)
+*/
+#define MEMFIND_MISSES	16
+#define MEMFIND_GAP	8
+
+
+/* Horspool search for candidates of `s2' (l2 >= 2) in [s1, end) */
+static const char *skipfind (const char *s1, const char *end,
+                               const char *s2, size_t l2) {
+  size_t skip[UCHAR_MAX + 1];
+  size_t i, last = l2 - 1;
+  for (i = 0; i <= UCHAR_MAX; i++)
+    skip[i] = l2;
+  for (i = 0; i < last; i++)
+    skip[uchar(s2[i])] = last - i;
+  while (s1 < end) {
+    unsigned char c = uchar(s1[last]);  /* check last char first */
+    if (c == uchar(s2[last]) && memcmp(s1, s2, last) == 0)
+      return s1;
+    s1 += skip[c];
+  }
+  return NULL;
+}
+
 
 static const char *lmemfind (const char *s1, size_t l1,
                                const char *s2, size_t l2) {
   if (l2 == 0) return s1;  /* empty strings are everywhere */
   else if (l2 > l1) return NULL;  /* avoids a negative `l1' */
   else {
-    const char *init;  /* to search for a `*s2' inside `s1' */
-    l2--;  /* 1st char will be checked by `memchr' */
-    l1 = l1-l2;  /* `s2' cannot be found after that */
-    while (l1 > 0 && (init = (const char *)memchr(s1, *s2, l1)) != NULL) {
-      init++;   /* 1st char is already checked */
-      if (memcmp(init, s2+1, l2) == 0)
-        return init-1;
-      else {  /* correct `l1' and `s1' to try again */
-        l1 -= init-s1;
-        s1 = init;
-      }
+    const char *init = s1;
+    const char *end = s1 + (l1 - l2) + 1;  /* `s2' cannot start after that */
+    size_t last = l2 - 1;
+    size_t misses = 0;
+    while (s1 < end &&
+           (s1 = (const char *)memchr(s1, *s2, end - s1)) != NULL) {
+      if (s1[last] == s2[last] && memcmp(s1 + 1, s2 + 1, last) == 0)
+        return s1;
+      s1++;  /* 1st char is a false candidate; try again after it */
+      if (++misses >= MEMFIND_MISSES && last > 0 &&
+          (size_t)(s1 - init) < misses * MEMFIND_GAP)
+        return skipfind(s1, end, s2, l2);
     }
     return NULL;  /* not found */
   }
 }
 
 
+/*
+** returns the first position from 's' on where a match of 'cp' may start,
+** or NULL if there is none
+*/
+static const char *nextstart (MatchState *ms, const CPattern *cp,
+                              const char *s) {
+  if (cp->lprefix > 0)
+    return lmemfind(s, ms->src_end - s, cp->prefix, cp->lprefix);
+  else if (cp->hasfirst) {
+    while (s < ms->src_end && !inset(cp->first, *s))
+      s++;
+    return (s < ms->src_end) ? s : NULL;
+  }
+  else return s;
+}
+
+
 static void push_onecapture (MatchState *ms, int i, const char *s,
                                                     const char *e) {
   if (i >= ms->level) {
@@ -597,20 +889,19 @@ static int str_find_aux (lua_State *L, int find) {
   else {
     MatchState ms;
     const char *s1 = s + init - 1;
-    int anchor = (*p == '^');
-    if (anchor) {
-      p++; lp--;  /* skip anchor character */
-    }
+    const CPattern *cp = getpattern(L, 2);
     ms.L = L;
     ms.matchdepth = MAXCCALLS;
     ms.src_init = s;
     ms.src_end = s + ls;
-    ms.p_end = p + lp;
+    ms.pi_end = cp->item + cp->nitems;
     do {
       const char *res;
+      if (!cp->anchor && (s1 = nextstart(&ms, cp, s1)) == NULL)
+        break;  /* no more places where a match can start */
       ms.level = 0;
       lua_assert(ms.matchdepth == MAXCCALLS);
-      if ((res=match(&ms, s1, p)) != NULL) {
+      if ((res=match(&ms, s1, cp->item)) != NULL) {
         if (find) {
           lua_pushinteger(L, s1 - s + 1);  /* start */
           lua_pushinteger(L, res - s);   /* end */
@@ -619,7 +910,7 @@ static int str_find_aux (lua_State *L, int find) {
         else
           return push_captures(&ms, s1, res);
       }
-    } while (s1++ < ms.src_end && !anchor);
+    } while (s1++ < ms.src_end && !cp->anchor);
   }
   lua_pushnil(L);  /* not found */
   return 1;
@@ -638,22 +929,24 @@ static int str_match (lua_State *L) {
 
 static int gmatch_aux (lua_State *L) {
   MatchState ms;
-  size_t ls, lp;
+  size_t ls;
   const char *s = lua_tolstring(L, lua_upvalueindex(1), &ls);
-  const char *p = lua_tolstring(L, lua_upvalueindex(2), &lp);
+  const CPattern *cp = (const CPattern *)lua_touserdata(L, lua_upvalueindex(2));
   const char *src;
   ms.L = L;
   ms.matchdepth = MAXCCALLS;
   ms.src_init = s;
   ms.src_end = s+ls;
-  ms.p_end = p + lp;
+  ms.pi_end = cp->item + cp->nitems;
   for (src = s + (size_t)lua_tointeger(L, lua_upvalueindex(3));
        src <= ms.src_end;
        src++) {
     const char *e;
+    if ((src = nextstart(&ms, cp, src)) == NULL)
+      break;  /* no more places where a match can start */
     ms.level = 0;
     lua_assert(ms.matchdepth == MAXCCALLS);
-    if ((e = match(&ms, src, p)) != NULL) {
+    if ((e = match(&ms, src, cp->item)) != NULL) {
       lua_Integer newstart = e-s;
       if (e == src) newstart++;  /* empty match? go at least one position */
       lua_pushinteger(L, newstart);
@@ -669,6 +962,13 @@ static int gmatch (lua_State *L) {
   luaL_checkstring(L, 1);
   luaL_checkstring(L, 2);
   lua_settop(L, 2);
+  if (*lua_tostring(L, 2) == '^') {  /* not an anchor here */
+    size_t lp;
+    const char *p = lua_tolstring(L, 2, &lp);
+    compile(L, p, lp, 0);
+  }
+  else getpattern(L, 2);
+  lua_replace(L, 2);  /* gmatch_aux needs only the compiled pattern */
   lua_pushinteger(L, 0);
   lua_pushcclosure(L, gmatch_aux, 3);
   return 1;
@@ -733,32 +1033,36 @@ static void add_value (MatchState *ms, luaL_Buffer *b, const char *s,
 
 
 static int str_gsub (lua_State *L) {
-  size_t srcl, lp;
+  size_t srcl;
   const char *src = luaL_checklstring(L, 1, &srcl);
-  const char *p = luaL_checklstring(L, 2, &lp);
+  const CPattern *cp;
   int tr = lua_type(L, 3);
   size_t max_s = luaL_optinteger(L, 4, srcl+1);
-  int anchor = (*p == '^');
   size_t n = 0;
   MatchState ms;
   luaL_Buffer b;
+  luaL_checkstring(L, 2);
   luaL_argcheck(L, tr == LUA_TNUMBER || tr == LUA_TSTRING ||
                    tr == LUA_TFUNCTION || tr == LUA_TTABLE, 3,
                       "string/function/table expected");
+  cp = getpattern(L, 2);
   luaL_buffinit(L, &b);
-  if (anchor) {
-    p++; lp--;  /* skip anchor character */
-  }
   ms.L = L;
   ms.matchdepth = MAXCCALLS;
   ms.src_init = src;
   ms.src_end = src+srcl;
-  ms.p_end = p + lp;
+  ms.pi_end = cp->item + cp->nitems;
   while (n < max_s) {
     const char *e;
+    if (!cp->anchor) {  /* skip places where no match can start */
+      const char *start = nextstart(&ms, cp, src);
+      if (start == NULL) break;
+      luaL_addlstring(&b, src, start - src);
+      src = start;
+    }
     ms.level = 0;
     lua_assert(ms.matchdepth == MAXCCALLS);
-    e = match(&ms, src, p);
+    e = match(&ms, src, cp->item);
     if (e) {
       n++;
       add_value(&ms, &b, src, e, tr);
@@ -768,7 +1072,7 @@ static int str_gsub (lua_State *L) {
     else if (src < ms.src_end)
       luaL_addchar(&b, *src++);
     else break;
-    if (anchor) break;
+    if (cp->anchor) break;
   }
   luaL_addlstring(&b, src, ms.src_end-src);
   luaL_pushresult(&b);
@@ -876,6 +1180,104 @@ static const char *scanformat (lua_State *L, const char *strfrmt, char *form) {
 }
 
 
+/* checks argument 'arg' for the integer conversions `%d' and `%i' */
+static LUA_INTFRM_T checkfrmint (lua_State *L, int arg) {
+  lua_Number n = luaL_checknumber(L, arg);
+  lua_Integer li = lua_tointeger(L, arg);
+  LUA_INTFRM_T ni = ((lua_Number)li == n) ? (LUA_INTFRM_T)li
+                                          : (LUA_INTFRM_T)n;
+  lua_Number diff = n - (lua_Number)ni;
+  luaL_argcheck(L, -1 < diff && diff < 1, arg,
+                "not a number in proper range");
+  return ni;
+}
+
+
+/* checks argument 'arg' for the conversions `%o', `%u', `%x' and `%X' */
+static unsigned LUA_INTFRM_T checkfrmuint (lua_State *L, int arg) {
+  lua_Number n = luaL_checknumber(L, arg);
+  lua_Integer li = lua_tointeger(L, arg);
+  unsigned LUA_INTFRM_T ni = (li >= 0 && (lua_Number)li == n)
+                           ? (unsigned LUA_INTFRM_T)li
+                           : (unsigned LUA_INTFRM_T)n;
+  lua_Number diff = n - (lua_Number)ni;
+  luaL_argcheck(L, -1 < diff && diff < 1, arg,
+                "not a non-negative number in proper range");
+  return ni;
+}
+
+
+/*
+** Formats the common items directly into 'buff': `%d', `%i', `%x' and
+** `%X' with an optional width and flags `-' or `0', and `%s' without
+** precision. Returns the number of bytes written and moves '*pfrmt'
+** past the item, or returns -1 (consuming nothing) for other items.
+*/
+static int fastformat (lua_State *L, luaL_Buffer *b, const char **pfrmt,
+                       char *buff, int arg) {
+  const char *p = *pfrmt;
+  char digits[3 * sizeof(LUA_INTFRM_T)];  /* enough for decimal or hex */
+  char *e = digits + sizeof(digits);  /* digits are written backwards */
+  const char *s;
+  size_t l, pad;
+  int left = 0, zero = 0, neg = 0;
+  size_t width = 0;
+  char *q = buff;
+  for (;; p++) {  /* flags */
+    if (*p == '-' && !left) left = 1;
+    else if (*p == '0' && !zero) zero = 1;
+    else break;
+  }
+  if (isdigit(uchar(*p))) width = *p++ - '0';
+  if (isdigit(uchar(*p))) width = width * 10 + (*p++ - '0');
+  switch (*p) {
+    case 'd': case 'i': {
+      LUA_INTFRM_T ni = checkfrmint(L, arg);
+      unsigned LUA_INTFRM_T u = (unsigned LUA_INTFRM_T)ni;
+      if (ni < 0) {
+        neg = 1;
+        u = 0u - u;
+      }
+      do { *--e = "0123456789"[u % 10]; u /= 10; } while (u != 0);
+      break;
+    }
+    case 'x': case 'X': {
+      const char *hex = (*p == 'x') ? "0123456789abcdef" : "0123456789ABCDEF";
+      unsigned LUA_INTFRM_T u = checkfrmuint(L, arg);
+      do { *--e = hex[u & 0xF]; u >>= 4; } while (u != 0);
+      break;
+    }
+    case 's': {
+      if (zero) return -1;  /* leave it to 'sprintf' */
+      s = luaL_tolstring(L, arg, &l);
+      *pfrmt = p + 1;
+      if (l >= 100) {  /* too long to be formatted; keep original string */
+        luaL_addvalue(b);
+        return 0;
+      }
+      l = strlen(s);  /* as `%s' in 'sprintf', stop at a zero */
+      pad = (width > l) ? width - l : 0;
+      if (!left) { memset(q, ' ', pad); q += pad; }
+      memcpy(q, s, l); q += l;
+      if (left) { memset(q, ' ', pad); q += pad; }
+      lua_pop(L, 1);  /* remove result from 'luaL_tolstring' */
+      return (int)(q - buff);
+    }
+    default: return -1;
+  }
+  s = e;
+  l = (digits + sizeof(digits)) - e;
+  pad = (width > l + neg) ? width - (l + neg) : 0;
+  if (!left && !zero) { memset(q, ' ', pad); q += pad; }
+  if (neg) *q++ = '-';
+  if (!left && zero) { memset(q, '0', pad); q += pad; }
+  memcpy(q, s, l); q += l;
+  if (left) { memset(q, ' ', pad); q += pad; }
+  *pfrmt = p + 1;
+  return (int)(q - buff);
+}
+
+
 /*
 ** add length modifier into formats
 */
@@ -908,6 +1310,11 @@ static int str_format (lua_State *L) {
       int nb = 0;  /* number of bytes in added item */
       if (++arg > top)
         luaL_argerror(L, arg, "no value");
+      if ((nb = fastformat(L, &b, &strfrmt, buff, arg)) >= 0) {
+        luaL_addsize(&b, nb);
+        continue;
+      }
+      nb = 0;
       strfrmt = scanformat(L, strfrmt, form);
       switch (*strfrmt++) {
         case 'c': {
@@ -915,21 +1322,13 @@ static int str_format (lua_State *L) {
           break;
         }
         case 'd': case 'i': {
-          lua_Number n = luaL_checknumber(L, arg);
-          LUA_INTFRM_T ni = (LUA_INTFRM_T)n;
-          lua_Number diff = n - (lua_Number)ni;
-          luaL_argcheck(L, -1 < diff && diff < 1, arg,
-                        "not a number in proper range");
+          LUA_INTFRM_T ni = checkfrmint(L, arg);
           addlenmod(form, LUA_INTFRMLEN);
           nb = sprintf(buff, form, ni);
           break;
         }
         case 'o': case 'u': case 'x': case 'X': {
-          lua_Number n = luaL_checknumber(L, arg);
-          unsigned LUA_INTFRM_T ni = (unsigned LUA_INTFRM_T)n;
-          lua_Number diff = n - (lua_Number)ni;
-          luaL_argcheck(L, -1 < diff && diff < 1, arg,
-                        "not a non-negative number in proper range");
+          unsigned LUA_INTFRM_T ni = checkfrmuint(L, arg);
           addlenmod(form, LUA_INTFRMLEN);
           nb = sprintf(buff, form, ni);
           break;
@@ -1012,7 +1411,9 @@ static void createmetatable (lua_State *L) {
 ** Open string library
 */
 LUAMOD_API int luaopen_string (lua_State *L) {
-  luaL_newlib(L, strlib);
+  luaL_newlibtable(L, strlib);
+  lua_createtable(L, 0, LUA_PATCACHESIZE);  /* pattern cache */
+  luaL_setfuncs(L, strlib, 1);
   createmetatable(L);
   return 1;
 }
@@ -16,6 +16,9 @@
 ** in its main position (i.e. the `original' position that its hash gives
 ** to it), then the colliding element is in its own main position.
 ** Hence even when the load factor reaches 100%, performance remains good.
+** A large hash part is rehashed incrementally: the old node vector stays
+** in `oldnode' and its entries move into the new one a few at a time, on
+** each insertion of a new key; lookups search both vectors meanwhile.
 */
 
 #include <string.h>
@@ -48,6 +51,20 @@
 #define MAXASIZE	(1 << MAXBITS)
 
 
+/*
+** hash parts with at least LUAI_MIGRATEMIN nodes are rehashed
+** incrementally, moving LUAI_MIGRATESTEP old nodes per new key (when
+** the array part keeps its size); 0 always rehashes in one step
+*/
+#if !defined(LUAI_MIGRATEMIN)
+#define LUAI_MIGRATEMIN		1024
+#endif
+
+#if !defined(LUAI_MIGRATESTEP)
+#define LUAI_MIGRATESTEP	8
+#endif
+
+
 #define hashpow2(t,n)		(gnode(t, lmod((n), sizenode(t))))
 
 #define hashstr(t,str)		hashpow2(t, (str)->tsv.hash)
@@ -70,7 +87,7 @@
 
 static const Node dummynode_ = {
   {NILCONSTANT},  /* value */
-  {{NILCONSTANT, NULL}}  /* key */
+  {{NILCONSTANT, 0}}  /* key */
 };
 
 
@@ -89,6 +106,18 @@ static Node *hashnum (const Table *t, lua_Number n) {
 }
 
 
+/*
+** hash for integer keys; folds the high half of wide integers into the
+** low one
+*/
+static Node *hashint (const Table *t, lua_Integer i) {
+  lu_integer ui = cast(lu_integer, i);
+  unsigned int h = cast(unsigned int, ui) ^
+                   cast(unsigned int, ui >> (sizeof(ui) * 4));
+  return hashmod(t, h);
+}
+
+
 
 /*
 ** returns the `main' position of an element in a table (that is, the index
@@ -96,8 +125,10 @@ static Node *hashnum (const Table *t, lua_Number n) {
 */
 static Node *mainposition (const Table *t, const TValue *key) {
   switch (ttype(key)) {
-    case LUA_TNUMBER:
-      return hashnum(t, nvalue(key));
+    case LUA_TNUMINT:
+      return hashint(t, ivalue(key));
+    case LUA_TNUMFLT:
+      return hashnum(t, fltvalue(key));
     case LUA_TLNGSTR: {
       TString *s = rawtsvalue(key);
       if (s->tsv.extra == 0) {  /* no hash? */
@@ -122,46 +153,86 @@ static Node *mainposition (const Table *t, const TValue *key) {
 
 /*
 ** returns the index for `key' if `key' is an appropriate key to live in
-** the array part of the table, -1 otherwise.
+** the array part of the table, -1 otherwise. (Keys stored in a table
+** with integral float values have already been converted to integers.)
 */
 static int arrayindex (const TValue *key) {
-  if (ttisnumber(key)) {
-    lua_Number n = nvalue(key);
-    int k;
-    lua_number2int(k, n);
-    if (luai_numeq(cast_num(k), n))
-      return k;
+  if (ttisinteger(key)) {
+    lua_Integer k = ivalue(key);
+    if (0 < k && k <= MAXASIZE)
+      return cast_int(k);
   }
   return -1;  /* `key' did not match some condition */
 }
 
 
+/*
+** if 'key' is a float with an integral value, return an equivalent
+** integer key in 'aux'; tables never keep such floats as keys
+*/
+static const TValue *normkey (const TValue *key, TValue *aux) {
+  lua_Integer k;
+  if (ttisfloat(key) && luaV_numtointeger(fltvalue(key), &k)) {
+    setivalue(aux, k);
+    return aux;
+  }
+  return key;
+}
+
+
+/*
+** a header addressing the old node vector of `t', so that `mainposition'
+** can hash into it
+*/
+static const Table *oldview (const Table *t, Table *old) {
+  old->node = t->oldnode;
+  old->lsizenode = t->lsizeold;
+  return old;
+}
+
+
+/*
+** returns the node of `key' in the chain starting at `n', or NULL
+*/
+static Node *findinchain (Node *n, const TValue *key) {
+  do {
+    /* key may be dead already, but it is ok to use it in `next' */
+    if (luaV_rawequalobj(gkey(n), key) ||
+          (ttisdeadkey(gkey(n)) && iscollectable(key) &&
+           deadvalue(gkey(n)) == gcvalue(key)))
+      return n;
+    n = nextnode(n);
+  } while (n != NULL);
+  return NULL;
+}
+
+
 /*
 ** returns the index of a `key' for table traversals. First goes all
 ** elements in the array part, then elements in the hash part. The
 ** beginning of a traversal is signaled by -1.
 */
-static int findindex (lua_State *L, Table *t, StkId key) {
+static int findindex (lua_State *L, Table *t, StkId rkey) {
   int i;
-  if (ttisnil(key)) return -1;  /* first iteration */
+  TValue aux;
+  const TValue *key;
+  if (ttisnil(rkey)) return -1;  /* first iteration */
+  key = normkey(rkey, &aux);
   i = arrayindex(key);
   if (0 < i && i <= t->sizearray)  /* is `key' inside array part? */
     return i-1;  /* yes; that's the index (corrected to C) */
   else {
-    Node *n = mainposition(t, key);
-    for (;;) {  /* check whether `key' is somewhere in the chain */
-      /* key may be dead already, but it is ok to use it in `next' */
-      if (luaV_rawequalobj(gkey(n), key) ||
-            (ttisdeadkey(gkey(n)) && iscollectable(key) &&
-             deadvalue(gkey(n)) == gcvalue(key))) {
-        i = cast_int(n - gnode(t, 0));  /* key index in hash table */
-        /* hash elements are numbered after array ones */
-        return i + t->sizearray;
-      }
-      else n = gnext(n);
-      if (n == NULL)
-        luaG_runerror(L, "invalid key to " LUA_QL("next"));  /* key not found */
+    Node *n = findinchain(mainposition(t, key), key);
+    if (n != NULL)  /* hash elements are numbered after array ones */
+      return cast_int(n - gnode(t, 0)) + t->sizearray;
+    if (t->oldnode != NULL) {  /* then come those of the old hash part */
+      Table old;
+      n = findinchain(mainposition(oldview(t, &old), key), key);
+      if (n != NULL)
+        return cast_int(n - t->oldnode) + sizenode(t) + t->sizearray;
     }
+    luaG_runerror(L, "invalid key to " LUA_QL("next"));  /* key not found */
+    return 0;  /* to avoid warnings */
   }
 }
 
@@ -170,7 +241,7 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
   int i = findindex(L, t, key);  /* find original element */
   for (i++; i < t->sizearray; i++) {  /* try first array part */
     if (!ttisnil(&t->array[i])) {  /* a non-nil value? */
-      setnvalue(key, cast_num(i+1));
+      setivalue(key, i+1);
       setobj2s(L, key+1, &t->array[i]);
       return 1;
     }
@@ -182,6 +253,16 @@ int luaH_next (lua_State *L, Table *t, StkId key) {
       return 1;
     }
   }
+  if (t->oldnode != NULL) {  /* then entries not migrated yet */
+    for (i -= sizenode(t); i < sizeoldnode(t); i++) {
+      Node *n = &t->oldnode[i];
+      if (!ttisnil(gval(n))) {
+        setobj2s(L, key, gkey(n));
+        setobj2s(L, key+1, gval(n));
+        return 1;
+      }
+    }
+  }
   return 0;  /* no more elements */
 }
 
@@ -262,6 +343,14 @@ static int numusehash (const Table *t, int *nums, int *pnasize) {
       totaluse++;
     }
   }
+  i = t->nextold;  /* entries still in the old hash part */
+  while (i--) {
+    Node *n = &t->oldnode[i];
+    if (!ttisnil(gval(n))) {
+      ause += countint(gkey(n), nums);
+      totaluse++;
+    }
+  }
   *pnasize += ause;
   return totaluse;
 }
@@ -276,28 +365,34 @@ static void setarrayvector (lua_State *L, Table *t, int size) {
 }
 
 
+static void clearnodes (Table *t, int size) {
+  int i;
+  for (i=0; i<size; i++) {
+    Node *n = gnode(t, i);
+    gnext(n) = 0;
+    setnilvalue(gkey(n));
+    setnilvalue(gval(n));
+  }
+  t->lastfree = gnode(t, size);  /* all positions are free */
+}
+
+
 static void setnodevector (lua_State *L, Table *t, int size) {
   int lsize;
   if (size == 0) {  /* no elements to hash part? */
     t->node = cast(Node *, dummynode);  /* use common `dummynode' */
     lsize = 0;
+    t->lastfree = gnode(t, size);  /* all positions are free */
   }
   else {
-    int i;
     lsize = luaO_ceillog2(size);
     if (lsize > MAXBITS)
       luaG_runerror(L, "table overflow");
     size = twoto(lsize);
     t->node = luaM_newvector(L, size, Node);
-    for (i=0; i<size; i++) {
-      Node *n = gnode(t, i);
-      gnext(n) = NULL;
-      setnilvalue(gkey(n));
-      setnilvalue(gval(n));
-    }
+    clearnodes(t, size);
   }
   t->lsizenode = cast_byte(lsize);
-  t->lastfree = gnode(t, size);  /* all positions are free */
 }
 
 
@@ -306,10 +401,15 @@ void luaH_resize (lua_State *L, Table *t, int nasize, int nhsize) {
   int oldasize = t->sizearray;
   int oldhsize = t->lsizenode;
   Node *nold = t->node;  /* save old hash ... */
+  Node *pending = t->oldnode;  /* ... and any part still being migrated */
+  int npending = t->nextold;
+  int lsizepending = t->lsizeold;
   if (nasize > oldasize)  /* array part must grow? */
     setarrayvector(L, t, nasize);
   /* create new hash part with appropriate size */
   setnodevector(L, t, nhsize);
+  t->oldnode = NULL;  /* the migration is completed below */
+  t->nextold = 0;
   if (nasize < oldasize) {  /* array part must shrink? */
     t->sizearray = nasize;
     /* re-insert elements from vanishing slice */
@@ -331,6 +431,47 @@ void luaH_resize (lua_State *L, Table *t, int nasize, int nhsize) {
   }
   if (!isdummy(nold))
     luaM_freearray(L, nold, cast(size_t, twoto(oldhsize))); /* free old array */
+  if (pending != NULL) {
+    for (i = npending - 1; i >= 0; i--) {
+      Node *old = pending+i;
+      if (!ttisnil(gval(old)))
+        setobjt2t(L, luaH_set(L, t, gkey(old)), gval(old));
+    }
+    luaM_freearray(L, pending, cast(size_t, twoto(lsizepending)));
+  }
+}
+
+
+/*
+** start an incremental rehash: the current hash part becomes the old
+** one, to be emptied into a new part of `nhsize' entries by `migrate'
+*/
+static void startmigration (lua_State *L, Table *t, int nhsize) {
+  Node *nold = t->node;
+  int oldhsize = t->lsizenode;
+  lua_assert(t->oldnode == NULL && !isdummy(nold));
+  setnodevector(L, t, nhsize);
+  t->oldnode = nold;
+  t->lsizeold = cast_byte(oldhsize);
+  t->nextold = twoto(oldhsize);
+}
+
+
+/*
+** removes all entries of `t' but keeps the sizes of both parts, so that
+** it can be refilled without rehashing
+*/
+void luaH_clear (lua_State *L, Table *t) {
+  int i;
+  for (i = 0; i < t->sizearray; i++)
+    setnilvalue(&t->array[i]);
+  if (!isdummy(t->node))
+    clearnodes(t, sizenode(t));
+  if (t->oldnode != NULL) {  /* drop a migration in progress */
+    luaM_freearray(L, t->oldnode, cast(size_t, sizeoldnode(t)));
+    t->oldnode = NULL;
+    t->nextold = 0;
+  }
 }
 
 
@@ -355,7 +496,11 @@ static void rehash (lua_State *L, Table *t, const TValue *ek) {
   /* compute new size for array part */
   na = computesizes(nums, &nasize);
   /* resize the table to new computed sizes */
-  luaH_resize(L, t, nasize, totaluse - na);
+  if (LUAI_MIGRATEMIN > 0 && t->oldnode == NULL && nasize == t->sizearray &&
+      !isdummy(t->node) && sizenode(t) >= LUAI_MIGRATEMIN)
+    startmigration(L, t, totaluse - na);
+  else
+    luaH_resize(L, t, nasize, totaluse - na);
 }
 
 
@@ -371,6 +516,9 @@ Table *luaH_new (lua_State *L) {
   t->flags = cast_byte(~0);
   t->array = NULL;
   t->sizearray = 0;
+  t->oldnode = NULL;
+  t->nextold = 0;
+  t->lsizeold = 0;
   setnodevector(L, t, 0);
   return t;
 }
@@ -379,6 +527,8 @@ Table *luaH_new (lua_State *L) {
 void luaH_free (lua_State *L, Table *t) {
   if (!isdummy(t->node))
     luaM_freearray(L, t->node, cast(size_t, sizenode(t)));
+  if (t->oldnode != NULL)
+    luaM_freearray(L, t->oldnode, cast(size_t, sizeoldnode(t)));
   luaM_freearray(L, t->array, t->sizearray);
   luaM_free(L, t);
 }
@@ -396,70 +546,147 @@ static Node *getfreepos (Table *t) {
 
 
 /*
-** inserts a new key into a hash table; first, check whether key's main
+** inserts a new key into the hash part; first, check whether key's main
 ** position is free. If not, check whether colliding node is in its main
 ** position or not: if it is not, move colliding node to an empty place and
 ** put new key in its main position; otherwise (colliding node is in its main
-** position), new key goes to an empty position.
+** position), new key goes to an empty position. Returns NULL when there
+** is no free position left.
 */
-TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
-  Node *mp;
-  if (ttisnil(key)) luaG_runerror(L, "table index is nil");
-  else if (ttisnumber(key) && luai_numisnan(L, nvalue(key)))
-    luaG_runerror(L, "table index is NaN");
-  mp = mainposition(t, key);
+static TValue *insertkey (lua_State *L, Table *t, const TValue *key) {
+  Node *mp = mainposition(t, key);
+  UNUSED(L);
   if (!ttisnil(gval(mp)) || isdummy(mp)) {  /* main position is taken? */
     Node *othern;
     Node *n = getfreepos(t);  /* get a free place */
-    if (n == NULL) {  /* cannot find a free place? */
-      rehash(L, t, key);  /* grow table */
-      /* whatever called 'newkey' take care of TM cache and GC barrier */
-      return luaH_set(L, t, key);  /* insert key into grown table */
-    }
+    if (n == NULL)  /* cannot find a free place? */
+      return NULL;
     lua_assert(!isdummy(n));
     othern = mainposition(t, gkey(mp));
     if (othern != mp) {  /* is colliding node out of its main position? */
       /* yes; move colliding node into free position */
-      while (gnext(othern) != mp) othern = gnext(othern);  /* find previous */
-      gnext(othern) = n;  /* redo the chain with `n' in place of `mp' */
+      while (othern + gnext(othern) != mp)  /* find previous */
+        othern += gnext(othern);
+      /* redo the chain with `n' in place of `mp' */
+      gnext(othern) = cast_int(n - othern);
       *n = *mp;  /* copy colliding node into free pos. (mp->next also goes) */
-      gnext(mp) = NULL;  /* now `mp' is free */
+      if (gnext(mp) != 0) {
+        gnext(n) += cast_int(mp - n);  /* correct 'next' */
+        gnext(mp) = 0;  /* now `mp' is free */
+      }
       setnilvalue(gval(mp));
     }
     else {  /* colliding node is in its own main position */
       /* new node will go into free position */
-      gnext(n) = gnext(mp);  /* chain new position */
-      gnext(mp) = n;
+      if (gnext(mp) != 0)
+        gnext(n) = cast_int((mp + gnext(mp)) - n);  /* chain new position */
+      else lua_assert(gnext(n) == 0);
+      gnext(mp) = cast_int(n - mp);
       mp = n;
     }
   }
   setobj2t(L, gkey(mp), key);
-  luaC_barrierback(L, obj2gco(t), key);
   lua_assert(ttisnil(gval(mp)));
   return gval(mp);
 }
 
 
+/*
+** moves up to `n' entries of the old hash part into the current one,
+** and frees the old part once it is empty. Stops early if the current
+** part is full; the next rehash then takes the remaining entries.
+*/
+static void migrate (lua_State *L, Table *t, int n) {
+  while (t->nextold > 0 && n-- > 0) {
+    Node *old = &t->oldnode[t->nextold - 1];
+    if (!ttisnil(gval(old))) {
+      /* doesn't need barrier/invalidate cache, as entry was
+         already present in the table */
+      TValue *cell = insertkey(L, t, gkey(old));
+      if (cell == NULL) return;
+      setobjt2t(L, cell, gval(old));
+      setnilvalue(gval(old));
+    }
+    setnilvalue(gkey(old));  /* lookups in the old part must miss it now */
+    t->nextold--;
+  }
+  if (t->nextold == 0) {
+    luaM_freearray(L, t->oldnode, cast(size_t, sizeoldnode(t)));
+    t->oldnode = NULL;
+  }
+}
+
+
+TValue *luaH_newkey (lua_State *L, Table *t, const TValue *key) {
+  TValue aux;
+  TValue *cell;
+  if (ttisnil(key)) luaG_runerror(L, "table index is nil");
+  else if (ttisfloat(key)) {
+    if (luai_numisnan(L, fltvalue(key)))
+      luaG_runerror(L, "table index is NaN");
+    key = normkey(key, &aux);  /* insert integral floats as integers */
+  }
+  if (t->oldnode != NULL)
+    migrate(L, t, LUAI_MIGRATESTEP);
+  cell = insertkey(L, t, key);
+  if (cell == NULL) {  /* no free place? */
+    rehash(L, t, key);  /* grow table */
+    /* whatever called 'newkey' take care of TM cache and GC barrier */
+    return luaH_set(L, t, key);  /* insert key into grown table */
+  }
+  luaC_barrierback(L, obj2gco(t), key);
+  return cell;
+}
+
+
+/*
+** search function for the old hash part, for keys that the current one
+** does not have while a migration is in progress
+*/
+static const TValue *getold (const Table *t, const TValue *key) {
+  Table old;
+  Node *n = mainposition(oldview(t, &old), key);
+  do {  /* check whether `key' is somewhere in the chain */
+    if (luaV_rawequalobj(gkey(n), key))
+      return gval(n);  /* that's it */
+    else n = nextnode(n);
+  } while (n);
+  return luaO_nilobject;
+}
+
+
 /*
 ** search function for integers
 */
-const TValue *luaH_getint (Table *t, int key) {
+const TValue *luaH_getint (Table *t, lua_Integer key) {
   /* (1 <= key && key <= t->sizearray) */
-  if (cast(unsigned int, key-1) < cast(unsigned int, t->sizearray))
+  if (cast(lu_integer, key) - 1u < cast(lu_integer, t->sizearray))
     return &t->array[key-1];
   else {
-    lua_Number nk = cast_num(key);
-    Node *n = hashnum(t, nk);
+    Node *n = hashint(t, key);
     do {  /* check whether `key' is somewhere in the chain */
-      if (ttisnumber(gkey(n)) && luai_numeq(nvalue(gkey(n)), nk))
+      if (ttisinteger(gkey(n)) && ivalue(gkey(n)) == key)
         return gval(n);  /* that's it */
-      else n = gnext(n);
+      else n = nextnode(n);
     } while (n);
+    if (t->oldnode != NULL) {
+      TValue k;
+      setivalue(&k, key);
+      return getold(t, &k);
+    }
     return luaO_nilobject;
   }
 }
 
 
+static const TValue *getoldstr (const Table *t, TString *key) {
+  TValue k;
+  val_(&k).gc = obj2gco(key);
+  settt_(&k, ctb(LUA_TSHRSTR));
+  return getold(t, &k);
+}
+
+
 /*
 ** search function for short strings
 */
@@ -469,8 +696,39 @@ const TValue *luaH_getstr (Table *t, TString *key) {
   do {  /* check whether `key' is somewhere in the chain */
     if (ttisshrstring(gkey(n)) && eqshrstr(rawtsvalue(gkey(n)), key))
       return gval(n);  /* that's it */
-    else n = gnext(n);
+    else n = nextnode(n);
   } while (n);
+  if (t->oldnode != NULL)
+    return getoldstr(t, key);
+  return luaO_nilobject;
+}
+
+
+/*
+** search function for short strings through an inline cache. A hit
+** needs the same node array and the same key in the remembered slot, so
+** a resize (new node array) or the reuse of that node for another key
+** makes the cache miss and be refilled.
+*/
+const TValue *luaH_getstrcached (Table *t, TString *key, ICache *c) {
+  Node *n;
+  lua_assert(key->tsv.tt == LUA_TSHRSTR);
+  if (c->node == t->node && c->slot < cast(unsigned int, sizenode(t))) {
+    n = gnode(t, c->slot);
+    if (ttisshrstring(gkey(n)) && eqshrstr(rawtsvalue(gkey(n)), key))
+      return gval(n);  /* cache hit */
+  }
+  n = hashstr(t, key);
+  do {  /* check whether `key' is somewhere in the chain */
+    if (ttisshrstring(gkey(n)) && eqshrstr(rawtsvalue(gkey(n)), key)) {
+      c->node = t->node;  /* remember where it is */
+      c->slot = cast(unsigned int, n - t->node);
+      return gval(n);
+    }
+    else n = nextnode(n);
+  } while (n);
+  if (t->oldnode != NULL)  /* not cached: it will move */
+    return getoldstr(t, key);
   return luaO_nilobject;
 }
 
@@ -482,11 +740,10 @@ const TValue *luaH_get (Table *t, const TValue *key) {
   switch (ttype(key)) {
     case LUA_TSHRSTR: return luaH_getstr(t, rawtsvalue(key));
     case LUA_TNIL: return luaO_nilobject;
-    case LUA_TNUMBER: {
-      int k;
-      lua_Number n = nvalue(key);
-      lua_number2int(k, n);
-      if (luai_numeq(cast_num(k), n)) /* index is int? */
+    case LUA_TNUMINT: return luaH_getint(t, ivalue(key));
+    case LUA_TNUMFLT: {
+      lua_Integer k;
+      if (luaV_numtointeger(fltvalue(key), &k)) /* index is integral? */
         return luaH_getint(t, k);  /* use specialized version */
       /* else go through */
     }
@@ -495,8 +752,10 @@ const TValue *luaH_get (Table *t, const TValue *key) {
       do {  /* check whether `key' is somewhere in the chain */
         if (luaV_rawequalobj(gkey(n), key))
           return gval(n);  /* that's it */
-        else n = gnext(n);
+        else n = nextnode(n);
       } while (n);
+      if (t->oldnode != NULL)
+        return getold(t, key);
       return luaO_nilobject;
     }
   }
@@ -515,14 +774,14 @@ TValue *luaH_set (lua_State *L, Table *t, const TValue *key) {
 }
 
 
-void luaH_setint (lua_State *L, Table *t, int key, TValue *value) {
+void luaH_setint (lua_State *L, Table *t, lua_Integer key, TValue *value) {
   const TValue *p = luaH_getint(t, key);
   TValue *cell;
   if (p != luaO_nilobject)
     cell = cast(TValue *, p);
   else {
     TValue k;
-    setnvalue(&k, cast_num(key));
+    setivalue(&k, key);
     cell = luaH_newkey(L, t, &k);
   }
   setobj2t(L, cell, value);
@@ -577,6 +836,146 @@ int luaH_getn (Table *t) {
 
 
 
+
+/*
+** {======================================================
+** Sorting of homogeneous array parts
+** =======================================================
+*/
+
+typedef int (*SortLT) (lua_State *L, const TValue *a, const TValue *b);
+
+static int lt_int (lua_State *L, const TValue *a, const TValue *b) {
+  UNUSED(L);
+  return ivalue(a) < ivalue(b);
+}
+
+static int lt_flt (lua_State *L, const TValue *a, const TValue *b) {
+  UNUSED(L);
+  return luai_numlt(L, fltvalue(a), fltvalue(b));
+}
+
+static int lt_any (lua_State *L, const TValue *a, const TValue *b) {
+  return luaV_lessthan(L, a, b);  /* mixed numbers or strings */
+}
+
+
+#define swapvalues(a,b)	{ TValue t_; t_ = *(a); *(a) = *(b); *(b) = t_; }
+
+
+static void siftdown (lua_State *L, TValue *a, int i, int n, SortLT lt) {
+  for (;;) {
+    int c = 2*i + 1;
+    if (c >= n) break;
+    if (c + 1 < n && lt(L, &a[c], &a[c + 1])) c++;
+    if (!lt(L, &a[i], &a[c])) break;
+    swapvalues(&a[i], &a[c]);
+    i = c;
+  }
+}
+
+
+static void heapsort (lua_State *L, TValue *a, int n, SortLT lt) {
+  int i;
+  for (i = n/2 - 1; i >= 0; i--)
+    siftdown(L, a, i, n, lt);
+  for (i = n - 1; i > 0; i--) {
+    swapvalues(&a[0], &a[i]);
+    siftdown(L, a, 0, i, lt);
+  }
+}
+
+
+static void insertionsort (lua_State *L, TValue *a, int n, SortLT lt) {
+  int i;
+  for (i = 1; i < n; i++) {
+    TValue v = a[i];
+    int j = i;
+    while (j > 0 && lt(L, &v, &a[j - 1])) {
+      a[j] = a[j - 1];
+      j--;
+    }
+    a[j] = v;
+  }
+}
+
+
+/*
+** Introsort: quicksort with median-of-three pivots, insertion sort for
+** small ranges and heapsort once the recursion gets too deep. All scans
+** are bounded, so an inconsistent order (NaNs) cannot run off the range.
+*/
+static void introsort (lua_State *L, TValue *a, int n, int depth,
+                       SortLT lt) {
+  while (n > 16) {
+    TValue p;
+    int i = 0, j = n - 1, m = (n - 1)/2;
+    if (depth-- == 0) {
+      heapsort(L, a, n, lt);
+      return;
+    }
+    if (lt(L, &a[m], &a[0])) swapvalues(&a[m], &a[0]);
+    if (lt(L, &a[n - 1], &a[m])) {
+      swapvalues(&a[n - 1], &a[m]);
+      if (lt(L, &a[m], &a[0])) swapvalues(&a[m], &a[0]);
+    }
+    p = a[m];
+    for (;;) {  /* invariant: a[0..i] <= P <= a[j..n-1] */
+      do i++; while (i < n - 1 && lt(L, &a[i], &p));
+      do j--; while (j > 0 && lt(L, &p, &a[j]));
+      if (i >= j) break;
+      swapvalues(&a[i], &a[j]);
+    }
+    /* a[0..j] <= P <= a[j+1..n-1]; recurse into the smaller part */
+    if (j + 1 < n - j - 1) {
+      introsort(L, a, j + 1, depth, lt);
+      a += j + 1; n -= j + 1;
+    }
+    else {
+      introsort(L, a + j + 1, n - j - 1, depth, lt);
+      n = j + 1;
+    }
+  }
+  insertionsort(L, a, n, lt);
+}
+
+
+/*
+** Sort t[1..n] in place when all those elements live in the array part
+** and are all numbers or all strings. With 'stable' set, only arrays
+** whose equal elements are indistinguishable (integers, strings) are
+** accepted. Returns 0 (leaving 't' untouched) when not applicable.
+*/
+int luaH_sort (lua_State *L, Table *t, int n, int stable) {
+  TValue *a = t->array;
+  SortLT lt;
+  int i, depth;
+  if (n > t->sizearray) return 0;
+  if (n < 2) return 1;
+  if (ttisstring(&a[0])) {
+    for (i = 1; i < n; i++)
+      if (!ttisstring(&a[i])) return 0;
+    lt = lt_any;
+  }
+  else if (ttisnumber(&a[0])) {
+    int nint = 0;
+    for (i = 0; i < n; i++) {
+      if (ttisinteger(&a[i])) nint++;
+      else if (!ttisnumber(&a[i])) return 0;
+    }
+    if (nint == n) lt = lt_int;
+    else if (stable) return 0;
+    else lt = (nint == 0) ? lt_flt : lt_any;
+  }
+  else return 0;
+  for (depth = 0, i = n; i > 0; i >>= 1) depth += 2;
+  introsort(L, a, n, depth, lt);
+  return 1;
+}
+
+/* }====================================================== */
+
+
 #if defined(LUA_DEBUG)
 
 Node *luaH_mainposition (const Table *t, const TValue *key) {
@@ -5,6 +5,7 @@
 */
 
 
+#include <limits.h>
 #include <stddef.h>
 
 #define ltablib_c
@@ -81,6 +82,50 @@ static int tremove (lua_State *L) {
 }
 
 
+/*
+** table.new(narr, nhash): a table with room for 'narr' array elements
+** and 'nhash' other fields, so that filling it does not rehash
+*/
+static int tnew (lua_State *L) {
+  int narr = luaL_optint(L, 1, 0);
+  int nhash = luaL_optint(L, 2, 0);
+  luaL_argcheck(L, narr >= 0, 1, "negative size");
+  luaL_argcheck(L, nhash >= 0, 2, "negative size");
+  lua_createtable(L, narr, nhash);
+  return 1;
+}
+
+
+/*
+** table.clear(t): removes all entries, keeping the allocated parts
+*/
+static int tclear (lua_State *L) {
+  luaL_checktype(L, 1, LUA_TTABLE);
+  lua_cleartable(L, 1);
+  return 0;
+}
+
+
+/*
+** table.move(a1, f, e, t [,a2]): a2[t..] = a1[f..e]; returns a2
+*/
+static int tmove (lua_State *L) {
+  int f = luaL_checkint(L, 2);
+  int e = luaL_checkint(L, 3);
+  int t = luaL_checkint(L, 4);
+  int tt = !lua_isnoneornil(L, 5) ? 5 : 1;  /* destination table */
+  luaL_checktype(L, 1, LUA_TTABLE);
+  luaL_checktype(L, tt, LUA_TTABLE);
+  if (e >= f) {
+    luaL_argcheck(L, f > 0 || e < INT_MAX + f, 3, "too many elements to move");
+    luaL_argcheck(L, t <= INT_MAX - (e - f), 4, "destination wrap around");
+    lua_rawmove(L, 1, f, e, tt, t);
+  }
+  lua_pushvalue(L, tt);
+  return 1;
+}
+
+
 static void addfield (lua_State *L, luaL_Buffer *b, int i) {
   lua_rawgeti(L, 1, i);
   if (!lua_isstring(L, -1))
@@ -98,7 +143,9 @@ static int tconcat (lua_State *L) {
   luaL_checktype(L, 1, LUA_TTABLE);
   i = luaL_optint(L, 3, 1);
   last = luaL_opt(L, luaL_checkint, 4, luaL_len(L, 1));
-  luaL_buffinit(L, &b);
+  if (i <= last && lua_concattable(L, 1, i, last, sep, lsep))
+    return 1;  /* all values were strings or numbers */
+  luaL_buffinit(L, &b);  /* else go one by one, to report the bad value */
   for (; i < last; i++) {
     addfield(L, &b, i);
     luaL_addlstring(&b, sep, lsep);
@@ -250,7 +297,73 @@ static int sort (lua_State *L) {
   if (!lua_isnoneornil(L, 2))  /* is there a 2nd argument? */
     luaL_checktype(L, 2, LUA_TFUNCTION);
   lua_settop(L, 2);  /* make sure there is two arguments */
-  auxsort(L, 1, n);
+  if (!lua_isnil(L, 2) || !lua_sortarray(L, 1, n, 0))
+    auxsort(L, 1, n);
+  return 0;
+}
+
+/* }====================================================== */
+
+
+
+/*
+** {======================================================
+** Merge sort (stable)
+** Runs are merged back and forth between two scratch tables at
+** indices 3 and 4, so the comparator never sees a half-sorted list.
+** =======================================================
+*/
+
+
+/* merge src[lo..mid-1] and src[mid..hi-1] into dst[lo..hi-1] */
+static void mergeruns (lua_State *L, int src, int dst,
+                       int lo, int mid, int hi) {
+  int i = lo, j = mid, k = lo;
+  while (i < mid && j < hi) {
+    lua_rawgeti(L, src, j);
+    lua_rawgeti(L, src, i);
+    if (sort_comp(L, -2, -1)) {  /* src[j] < src[i]? */
+      lua_pop(L, 1);  /* take src[j] */
+      j++;
+    }
+    else {  /* on ties, the left run goes first */
+      lua_remove(L, -2);  /* take src[i] */
+      i++;
+    }
+    lua_rawseti(L, dst, k++);
+  }
+  for (; i < mid; i++) {
+    lua_rawgeti(L, src, i);
+    lua_rawseti(L, dst, k++);
+  }
+  for (; j < hi; j++) {
+    lua_rawgeti(L, src, j);
+    lua_rawseti(L, dst, k++);
+  }
+}
+
+static int stablesort (lua_State *L) {
+  int n = aux_getn(L, 1);
+  int src = 3, dst = 4;
+  int i, width;
+  if (!lua_isnoneornil(L, 2))  /* is there a 2nd argument? */
+    luaL_checktype(L, 2, LUA_TFUNCTION);
+  lua_settop(L, 2);  /* make sure there is two arguments */
+  if (n < 2 || (lua_isnil(L, 2) && lua_sortarray(L, 1, n, 1)))
+    return 0;
+  lua_createtable(L, n, 0);  /* src */
+  lua_createtable(L, n, 0);  /* dst */
+  lua_rawmove(L, 1, 1, n, src, 1);
+  for (width = 1; width < n; width *= 2) {
+    for (i = 1; i <= n; i += 2 * width) {
+      int mid = (n - i < width) ? n + 1 : i + width;
+      int hi = (n + 1 - mid < width) ? n + 1 : mid + width;
+      mergeruns(L, src, dst, i, mid, hi);
+    }
+    src = 7 - src; dst = 7 - dst;  /* swap roles of the scratch tables */
+    if (width > INT_MAX / 2) break;
+  }
+  lua_rawmove(L, src, 1, n, 1, 1);
   return 0;
 }
 
@@ -263,10 +376,14 @@ static const luaL_Reg tab_funcs[] = {
   {"maxn", maxn},
 #endif
   {"insert", tinsert},
+  {"new", tnew},
+  {"clear", tclear},
+  {"move", tmove},
   {"pack", pack},
   {"unpack", unpack},
   {"remove", tremove},
   {"sort", sort},
+  {"stablesort", stablesort},
   {NULL, NULL}
 };
 
@@ -477,9 +477,20 @@ static int pmain (lua_State *L) {
 }
 
 
+/*
+** LUA_USE_POOLALLOC runs the interpreter on the size-class pool
+** allocator of lauxlib instead of plain 'realloc'
+*/
+#if defined(LUA_USE_POOLALLOC)
+#define lua_newmainstate()	luaL_newstatepool()
+#else
+#define lua_newmainstate()	luaL_newstate()
+#endif
+
+
 int main (int argc, char **argv) {
   int status, result;
-  lua_State *L = luaL_newstate();  /* create state */
+  lua_State *L = lua_newmainstate();  /* create state */
   if (L == NULL) {
     l_message(argv[0], "cannot create state: not enough memory");
     return EXIT_FAILURE;
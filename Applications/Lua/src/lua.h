@@ -13,3 +13,88 @@
   WITHOUT WARRANTIES OR REPRESENTATIONS OF ANY KIND, EITHER EXPRESS OR IMPLIED.
 **/
 #include <Lua/lua.h>
+
+
+#ifndef lua_tableops_h
+#define lua_tableops_h
+
+LUA_API void  (lua_cleartable) (lua_State *L, int idx);
+LUA_API void  (lua_rawmove) (lua_State *L, int idx1, int f, int e,
+                             int idx2, int t);
+LUA_API int   (lua_sortarray) (lua_State *L, int idx, int n, int stable);
+LUA_API int   (lua_concattable) (lua_State *L, int idx, int i, int j,
+                                 const char *sep, size_t lsep);
+
+#endif
+
+
+#ifndef lua_gcstats_h
+#define lua_gcstats_h
+
+/*
+** collector statistics; times are in nanoseconds
+*/
+#define LUA_GCPPROPAGATE	0
+#define LUA_GCPATOMIC		1
+#define LUA_GCPSWEEP		2
+#define LUA_GCPFINALIZE		3
+#define LUA_GCNPHASES		4
+
+/* 'pauses[0]' counts steps shorter than 1us; 'pauses[i]' those shorter
+   than 2^i us; the last bin, all longer ones */
+#define LUA_GCNPAUSEBINS	16
+
+typedef struct lua_GCStats {
+  lua_Number phasetime[LUA_GCNPHASES];  /* time spent in each phase */
+  lua_Number objmarked;  /* objects marked */
+  lua_Number bytesmarked;  /* bytes traversed by the mark phase */
+  lua_Number objswept;  /* objects freed by the sweep phase */
+  lua_Number bytesswept;  /* bytes freed by the sweep phase */
+  lua_Number finalizers;  /* finalizers called */
+  lua_Number steps;  /* collector steps */
+  lua_Number maxpause;  /* longest step */
+  lua_Number pauses[LUA_GCNPAUSEBINS];  /* histogram of step lengths */
+  lua_Number cycles;  /* collection cycles completed */
+  lua_Number gencycles;  /* minor collections in generational mode */
+  lua_Number fullcycles;  /* full collections */
+  lua_Number emergencies;  /* emergency collections */
+} lua_GCStats;
+
+LUA_API void  (lua_gcstats) (lua_State *L, lua_GCStats *s, int reset);
+
+#endif
+
+
+#ifndef lua_memlimit_h
+#define lua_memlimit_h
+
+/*
+** low-memory handler: called when an allocation of 'nsize' bytes fails
+** or would go over the memory limit, after an emergency collection.
+** It must not call Lua nor allocate from the state; it may release
+** memory held elsewhere or raise the limit, and returns nonzero to have
+** the allocation tried once more.
+*/
+typedef int (*lua_LowMemory) (void *ud, lua_State *L, size_t nsize);
+
+LUA_API size_t (lua_setmemlimit) (lua_State *L, size_t limit);
+LUA_API size_t (lua_getmemlimit) (lua_State *L);
+LUA_API size_t (lua_mempeak) (lua_State *L, int reset);
+LUA_API void  (lua_setlowmemory) (lua_State *L, lua_LowMemory f, void *ud);
+
+#endif
+
+
+#ifndef lua_gctime_h
+#define lua_gctime_h
+
+/*
+** time-sliced collection (see 'lua_gc'): LUA_GCSETSTEPTIME sets the
+** budget of each incremental step in microseconds (0 goes back to
+** steps measured in work units); LUA_GCIDLE spends up to 'data'
+** microseconds on collector work and returns 1 if it finished a cycle
+*/
+#define LUA_GCSETSTEPTIME	12
+#define LUA_GCIDLE		13
+
+#endif
@@ -260,7 +260,10 @@ static void PrintConstant(const Proto* f, int i)
 	printf(bvalue(o) ? "true" : "false");
 	break;
   case LUA_TNUMBER:
-	printf(LUA_NUMBER_FMT,nvalue(o));
+	if (ttisinteger(o))
+	 printf(LUA_INTEGER_FMT,(long long)ivalue(o));
+	else
+	 printf(LUA_NUMBER_FMT,nvalue(o));
 	break;
   case LUA_TSTRING:
 	PrintString(rawtsvalue(o));
@@ -69,6 +69,13 @@ static lua_Number LoadNumber(LoadState* S)
  return x;
 }
 
+static lua_Integer LoadInteger(LoadState* S)
+{
+ lua_Integer x;
+ LoadVar(S,x);
+ return x;
+}
+
 static TString* LoadString(LoadState* S)
 {
  size_t size;
@@ -115,10 +122,14 @@ static void LoadConstants(LoadState* S, Proto* f)
    case LUA_TNUMBER:
 	setnvalue(o,LoadNumber(S));
 	break;
+   case LUA_TNUMINT:
+	setivalue(o,LoadInteger(S));
+	break;
    case LUA_TSTRING:
 	setsvalue2n(S->L,o,LoadString(S));
 	break;
-    default: lua_assert(0);
+   default:
+	error(S,"bad constant in");
   }
  }
  n=LoadInt(S);
@@ -179,13 +190,14 @@ static void LoadFunction(LoadState* S, Proto* f)
  LoadConstants(S,f);
  LoadUpvalues(S,f);
  LoadDebug(S,f);
+ luaF_initicache(S->L,f);
 }
 
 /* the code below must be consistent with the code in luaU_header */
 #define N0	LUAC_HEADERSIZE
 #define N1	(sizeof(LUA_SIGNATURE)-sizeof(char))
 #define N2	N1+2
-#define N3	N2+6
+#define N3	N2+7
 
 static void LoadHeader(LoadState* S)
 {
@@ -234,7 +246,7 @@ Closure* luaU_undump (lua_State* L, ZIO* Z, Mbuffer* buff, const char* name)
 
 #define MYINT(s)	(s[0]-'0')
 #define VERSION		MYINT(LUA_VERSION_MAJOR)*16+MYINT(LUA_VERSION_MINOR)
-#define FORMAT		0		/* this is the official format */
+#define FORMAT		1		/* official format plus integer constants */
 
 /*
 * make header for precompiled chunks
@@ -253,6 +265,7 @@ void luaU_header (lu_byte* h)
  *h++=cast_byte(sizeof(size_t));
  *h++=cast_byte(sizeof(Instruction));
  *h++=cast_byte(sizeof(lua_Number));
+ *h++=cast_byte(sizeof(lua_Integer));
  *h++=cast_byte(((lua_Number)0.5)==0);		/* is lua_Number integral? */
  memcpy(h,LUAC_TAIL,sizeof(LUAC_TAIL)-sizeof(char));
 }
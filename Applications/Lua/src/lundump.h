@@ -23,6 +23,6 @@ LUAI_FUNC int luaU_dump (lua_State* L, const Proto* f, lua_Writer w, void* data,
 #define LUAC_TAIL		"\x19\x93\r\n\x1a\n"
 
 /* size in bytes of header of binary files */
-#define LUAC_HEADERSIZE		(sizeof(LUA_SIGNATURE)-sizeof(char)+2+6+sizeof(LUAC_TAIL)-sizeof(char))
+#define LUAC_HEADERSIZE		(sizeof(LUA_SIGNATURE)-sizeof(char)+2+7+sizeof(LUAC_TAIL)-sizeof(char))
 
 #endif
@@ -32,15 +32,51 @@
 #define MAXTAGLOOP	100
 
 
+/* wrap-around integer operations (overflow is checked by the caller) */
+#define intop(op,v1,v2) \
+	cast(lua_Integer, cast(lu_integer, v1) op cast(lu_integer, v2))
+
+
 const TValue *luaV_tonumber (const TValue *obj, TValue *n) {
   lua_Number num;
+  lua_Integer i;
   if (ttisnumber(obj)) return obj;
-  if (ttisstring(obj) && luaO_str2d(svalue(obj), tsvalue(obj)->len, &num)) {
-    setnvalue(n, num);
-    return n;
+  if (ttisstring(obj)) {
+    if (luaO_str2int(svalue(obj), tsvalue(obj)->len, &i)) {
+      setivalue(n, i);
+      return n;
+    }
+    else if (luaO_str2d(svalue(obj), tsvalue(obj)->len, &num)) {
+      setnvalue(n, num);
+      return n;
+    }
+  }
+  return NULL;
+}
+
+
+/*
+** try to convert a float to an integer with the same value; fails if
+** 'n' has a fractional part, is out of the range of lua_Integer or is NaN
+*/
+int luaV_numtointeger (lua_Number n, lua_Integer *p) {
+  lua_Number f = l_mathop(floor)(n);
+  if (!luai_numeq(n, f))  /* not an integral value (or NaN)? */
+    return 0;
+  else if (!(f >= cast_num(MIN_LUAINTEGER) && f < -cast_num(MIN_LUAINTEGER)))
+    return 0;  /* out of range */
+  *p = cast(lua_Integer, f);
+  return 1;
+}
+
+
+static int numtostr (const TValue *obj, char *s) {
+  if (ttisinteger(obj))
+    return lua_integer2str(s, ivalue(obj));
+  else {
+    lua_Number n = fltvalue(obj);
+    return luaO_num2str(s, n);
   }
-  else
-    return NULL;
 }
 
 
@@ -49,8 +85,7 @@ int luaV_tostring (lua_State *L, StkId obj) {
     return 0;
   else {
     char s[LUAI_MAXNUMBER2STR];
-    lua_Number n = nvalue(obj);
-    int l = lua_number2str(s, n);
+    int l = numtostr(obj, s);
     setsvalue2s(L, obj, luaS_newlstr(L, s, l));
     return 1;
   }
@@ -228,10 +263,69 @@ static int l_strcmp (const TString *ls, const TString *rs) {
 }
 
 
+/*
+** compare an integer with a float (not a NaN): 'i < f' (or 'i <= f' if
+** 'le'). The float is rounded to an integer in the direction that keeps
+** the result exact, so large integers are not converted to floats.
+*/
+static int LTintfloat (lua_Integer i, lua_Number f, int le) {
+  f = le ? l_mathop(floor)(f) : l_mathop(ceil)(f);
+  if (f >= -cast_num(MIN_LUAINTEGER))  /* f >= 2^63? */
+    return 1;
+  else if (f < cast_num(MIN_LUAINTEGER))
+    return 0;
+  else {
+    lua_Integer fi = cast(lua_Integer, f);
+    return le ? i <= fi : i < fi;
+  }
+}
+
+
+/*
+** 'l < r' (or 'l <= r' if 'le') for two numbers of any subtype
+*/
+static int LTnum (lua_State *L, const TValue *l, const TValue *r, int le) {
+  UNUSED(L);
+  if (ttisinteger(l)) {
+    if (ttisinteger(r))
+      return le ? ivalue(l) <= ivalue(r) : ivalue(l) < ivalue(r);
+    else if (luai_numisnan(L, fltvalue(r)))
+      return 0;
+    else
+      return LTintfloat(ivalue(l), fltvalue(r), le);
+  }
+  else if (ttisinteger(r)) {  /* float 'l' against integer 'r' */
+    if (luai_numisnan(L, fltvalue(l)))
+      return 0;
+    return !LTintfloat(ivalue(r), fltvalue(l), !le);  /* l < r <=> !(r <= l) */
+  }
+  else {
+    lua_Number nl = fltvalue(l), nr = fltvalue(r);
+    return le ? luai_numle(L, nl, nr) : luai_numlt(L, nl, nr);
+  }
+}
+
+
+/*
+** equality of two numbers of any subtype
+*/
+static int numeq (const TValue *t1, const TValue *t2) {
+  lua_Integer i;
+  if (ttisinteger(t1) && ttisinteger(t2))
+    return ivalue(t1) == ivalue(t2);
+  else if (ttisfloat(t1) && ttisfloat(t2))
+    return luai_numeq(fltvalue(t1), fltvalue(t2));
+  else if (ttisinteger(t1))
+    return luaV_numtointeger(fltvalue(t2), &i) && i == ivalue(t1);
+  else
+    return luaV_numtointeger(fltvalue(t1), &i) && i == ivalue(t2);
+}
+
+
 int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r) {
   int res;
   if (ttisnumber(l) && ttisnumber(r))
-    return luai_numlt(L, nvalue(l), nvalue(r));
+    return LTnum(L, l, r, 0);
   else if (ttisstring(l) && ttisstring(r))
     return l_strcmp(rawtsvalue(l), rawtsvalue(r)) < 0;
   else if ((res = call_orderTM(L, l, r, TM_LT)) < 0)
@@ -243,7 +337,7 @@ int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r) {
 int luaV_lessequal (lua_State *L, const TValue *l, const TValue *r) {
   int res;
   if (ttisnumber(l) && ttisnumber(r))
-    return luai_numle(L, nvalue(l), nvalue(r));
+    return LTnum(L, l, r, 1);
   else if (ttisstring(l) && ttisstring(r))
     return l_strcmp(rawtsvalue(l), rawtsvalue(r)) <= 0;
   else if ((res = call_orderTM(L, l, r, TM_LE)) >= 0)  /* first try `le' */
@@ -259,10 +353,10 @@ int luaV_lessequal (lua_State *L, const TValue *l, const TValue *r) {
 */
 int luaV_equalobj_ (lua_State *L, const TValue *t1, const TValue *t2) {
   const TValue *tm;
-  lua_assert(ttisequal(t1, t2));
+  lua_assert(eqtype(t1, t2));
   switch (ttype(t1)) {
     case LUA_TNIL: return 1;
-    case LUA_TNUMBER: return luai_numeq(nvalue(t1), nvalue(t2));
+    case LUA_TNUMFLT: case LUA_TNUMINT: return numeq(t1, t2);
     case LUA_TBOOLEAN: return bvalue(t1) == bvalue(t2);  /* true must be 1 !! */
     case LUA_TLIGHTUSERDATA: return pvalue(t1) == pvalue(t2);
     case LUA_TLCF: return fvalue(t1) == fvalue(t2);
@@ -332,6 +426,72 @@ void luaV_concat (lua_State *L, int total) {
 }
 
 
+/*
+** Concatenate t[i..j] (i <= j) with separator 'sep' and push the result.
+** A first pass sums the lengths, formatting numbers once into the
+** concatenation buffer; a second pass fills a single new string. Returns
+** 0, pushing nothing, if some element is neither a string nor a number.
+*/
+int luaV_concattable (lua_State *L, Table *t, int i, int j,
+                      const char *sep, size_t lsep) {
+  Mbuffer *buff = &G(L)->buff;
+  char shortbuff[LUAI_MAXSHORTLEN];
+  size_t tl = 0;  /* total length */
+  size_t nl = 0;  /* used part of 'buff' */
+  TString *ts = NULL;
+  char *p;
+  int k;
+  for (k = i; ; k++) {
+    const TValue *o = luaH_getint(t, k);
+    size_t l;
+    if (ttisstring(o))
+      l = tsvalue(o)->len;
+    else if (ttisnumber(o)) {
+      size_t room = LUAI_MAXNUMBER2STR + 1;
+      if (luaZ_sizebuffer(buff) - nl < room)
+        luaZ_resizebuffer(L, buff, 2*luaZ_sizebuffer(buff) + room);
+      l = numtostr(o, luaZ_buffer(buff) + nl);
+      luaZ_buffer(buff)[nl + l] = '\0';
+      nl += l + 1;
+    }
+    else return 0;
+    if (k != j) l += lsep;
+    if (l >= (MAX_SIZET/sizeof(char)) - tl)
+      luaG_runerror(L, "string length overflow");
+    tl += l;
+    if (k == j) break;
+  }
+  if (tl <= LUAI_MAXSHORTLEN)
+    p = shortbuff;
+  else {
+    ts = luaS_newlngstr(L, tl);
+    p = cast(char *, getstr(ts));
+  }
+  nl = 0;
+  for (k = i; ; k++) {
+    const TValue *o = luaH_getint(t, k);
+    if (ttisstring(o)) {
+      memcpy(p, svalue(o), tsvalue(o)->len * sizeof(char));
+      p += tsvalue(o)->len;
+    }
+    else {  /* a number formatted by the first pass */
+      const char *s = luaZ_buffer(buff) + nl;
+      size_t l = strlen(s);
+      memcpy(p, s, l * sizeof(char));
+      p += l;
+      nl += l + 1;
+    }
+    if (k == j) break;
+    memcpy(p, sep, lsep * sizeof(char));
+    p += lsep;
+  }
+  if (ts == NULL)
+    ts = luaS_newlstr(L, shortbuff, tl);
+  setsvalue2s(L, L->top, ts);
+  return 1;
+}
+
+
 void luaV_objlen (lua_State *L, StkId ra, const TValue *rb) {
   const TValue *tm;
   switch (ttypenv(rb)) {
@@ -339,11 +499,11 @@ void luaV_objlen (lua_State *L, StkId ra, const TValue *rb) {
       Table *h = hvalue(rb);
       tm = fasttm(L, h->metatable, TM_LEN);
       if (tm) break;  /* metamethod? break switch to call it */
-      setnvalue(ra, cast_num(luaH_getn(h)));  /* else primitive len */
+      setivalue(ra, luaH_getn(h));  /* else primitive len */
       return;
     }
     case LUA_TSTRING: {
-      setnvalue(ra, cast_num(tsvalue(rb)->len));
+      setivalue(ra, cast(lua_Integer, tsvalue(rb)->len));
       return;
     }
     default: {  /* try metamethod */
@@ -362,10 +522,8 @@ void luaV_arith (lua_State *L, StkId ra, const TValue *rb,
   TValue tempb, tempc;
   const TValue *b, *c;
   if ((b = luaV_tonumber(rb, &tempb)) != NULL &&
-      (c = luaV_tonumber(rc, &tempc)) != NULL) {
-    lua_Number res = luaO_arith(op - TM_ADD + LUA_OPADD, nvalue(b), nvalue(c));
-    setnvalue(ra, res);
-  }
+      (c = luaV_tonumber(rc, &tempc)) != NULL)
+    luaO_arithnum(op - TM_ADD + LUA_OPADD, b, c, ra);
   else if (!call_binTM(L, rb, rc, ra, op))
     luaG_aritherror(L, rb, rc);
 }
@@ -417,6 +575,40 @@ static void pushclosure (lua_State *L, Proto *p, UpVal **encup, StkId base,
 }
 
 
+/*
+** prepare an integer 'for' loop: when initial value, limit and step are
+** all integers, replace the limit by the number of iterations still to
+** be done, so that 'OP_FORLOOP' never overflows the control variable.
+** Returns 0 when the loop must be done with floats (zero step or an
+** iteration count that does not fit).
+*/
+static int forprepint (StkId ra) {
+  lua_Integer init, limit, step;
+  lu_integer count;
+  if (!(ttisinteger(ra) && ttisinteger(ra+1) && ttisinteger(ra+2)))
+    return 0;
+  init = ivalue(ra); limit = ivalue(ra+1); step = ivalue(ra+2);
+  if (step == 0)
+    return 0;  /* loops forever; keep the original behavior */
+  else if (step > 0 ? init > limit : init < limit)
+    count = 0;  /* loop does not run */
+  else {
+    if (step > 0)
+      count = (cast(lu_integer, limit) - cast(lu_integer, init)) /
+              cast(lu_integer, step);
+    else  /* avoid negating MIN_LUAINTEGER */
+      count = (cast(lu_integer, init) - cast(lu_integer, limit)) /
+              (cast(lu_integer, -(step + 1)) + 1u);
+    if (count == ~cast(lu_integer, 0))
+      return 0;  /* 'count + 1' does not fit */
+    count++;  /* the first iteration also counts */
+  }
+  setivalue(ra+1, cast(lua_Integer, count));
+  setivalue(ra, intop(-, init, step));  /* 'OP_FORLOOP' adds it back */
+  return 1;
+}
+
+
 /*
 ** finish execution of an opcode interrupted by an yield
 */
@@ -517,6 +709,28 @@ void luaV_finishOp (lua_State *L) {
            luai_threadyield(L); )
 
 
+/* integer fast paths: evaluate to false when the result overflows */
+#define intadd(L,a,b,r)	((r) = intop(+, a, b), (((a) ^ (r)) & ((b) ^ (r))) >= 0)
+#define intsub(L,a,b,r)	((r) = intop(-, a, b), (((a) ^ (b)) & ((a) ^ (r))) >= 0)
+#define intmul(L,a,b,r)	luaO_intarith(LUA_OPMUL, a, b, &(r))
+#define intmod(L,a,b,r)	luaO_intarith(LUA_OPMOD, a, b, &(r))
+
+
+/*
+** table access with the key in RK(C): constant short-string keys on
+** tables go through the instruction's inline cache; a nil result needs
+** the full path, as it may call an '__index' metamethod
+*/
+#define gettable_cached(t,v) { \
+        TValue *rc = RKC(i); \
+        const TValue *res; \
+        if (ttistable(t) && ISK(GETARG_C(i)) && ttisshrstring(rc) && \
+            !ttisnil(res = luaH_getstrcached(hvalue(t), rawtsvalue(rc), \
+               &cl->p->icache[pcRel(ci->u.l.savedpc, cl->p)]))) \
+          { setobj2s(L, v, res); } \
+        else Protect(luaV_gettable(L, t, rc, v)); }
+
+
 #define arith_op(op,tm) { \
         TValue *rb = RKB(i); \
         TValue *rc = RKC(i); \
@@ -526,16 +740,86 @@ void luaV_finishOp (lua_State *L) {
         } \
         else { Protect(luaV_arith(L, ra, rb, rc, tm)); } }
 
+/* same as 'arith_op', but keeps integer operands as integers */
+#define arith_iop(iop,op,tm) { \
+        TValue *rb = RKB(i); \
+        TValue *rc = RKC(i); \
+        lua_Integer res; \
+        if (ttisinteger(rb) && ttisinteger(rc) && \
+            iop(L, ivalue(rb), ivalue(rc), res)) { \
+          setivalue(ra, res); \
+        } \
+        else if (ttisnumber(rb) && ttisnumber(rc)) { \
+          lua_Number nb = nvalue(rb), nc = nvalue(rc); \
+          setnvalue(ra, op(L, nb, nc)); \
+        } \
+        else { Protect(luaV_arith(L, ra, rb, rc, tm)); } }
+
+
+/*
+** fetch next instruction, call hooks if needed and compute `ra'
+*/
+#define vmfetch()	{ \
+  i = *(ci->u.l.savedpc++); \
+  if ((L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) && \
+      (--L->hookcount == 0 || L->hookmask & LUA_MASKLINE)) { \
+    Protect(traceexec(L)); \
+  } \
+  /* WARNING: several calls may realloc the stack and invalidate `ra' */ \
+  ra = RA(i); \
+  lua_assert(base == ci->u.l.base); \
+  lua_assert(base <= L->top && L->top < L->stack + L->stacksize); \
+}
+
+
+/*
+** LUA_USE_JUMPTABLE selects a threaded dispatch: each opcode handler
+** fetches the next instruction and jumps straight to its handler through
+** a table of label addresses, instead of going back to a single 'switch'.
+** It needs the "labels as values" extension (GCC, Clang); other compilers
+** (e.g., MSFT) silently keep the portable 'switch' dispatch.
+*/
+#if defined(LUA_USE_JUMPTABLE) && !defined(__GNUC__)
+#undef LUA_USE_JUMPTABLE
+#endif
+
+#if defined(LUA_USE_JUMPTABLE)
+
+#define vmdispatch(o)	goto *disptab[o];
+#define vmcase(l,b)	L_##l: {b}  vmfetch(); vmdispatch(GET_OPCODE(i))
+#define vmcasenb(l,b)	L_##l: {b}		/* nb = no break */
+
+#else
 
 #define vmdispatch(o)	switch(o)
 #define vmcase(l,b)	case l: {b}  break;
 #define vmcasenb(l,b)	case l: {b}		/* nb = no break */
 
+#endif
+
+
 void luaV_execute (lua_State *L) {
   CallInfo *ci = L->ci;
   LClosure *cl;
   TValue *k;
   StkId base;
+  Instruction i;
+  StkId ra;
+#if defined(LUA_USE_JUMPTABLE)
+  /* ORDER OP */
+  static const void *const disptab[NUM_OPCODES] = {
+    &&L_OP_MOVE, &&L_OP_LOADK, &&L_OP_LOADKX, &&L_OP_LOADBOOL,
+    &&L_OP_LOADNIL, &&L_OP_GETUPVAL, &&L_OP_GETTABUP, &&L_OP_GETTABLE,
+    &&L_OP_SETTABUP, &&L_OP_SETUPVAL, &&L_OP_SETTABLE, &&L_OP_NEWTABLE,
+    &&L_OP_SELF, &&L_OP_ADD, &&L_OP_SUB, &&L_OP_MUL, &&L_OP_DIV,
+    &&L_OP_MOD, &&L_OP_POW, &&L_OP_UNM, &&L_OP_NOT, &&L_OP_LEN,
+    &&L_OP_CONCAT, &&L_OP_JMP, &&L_OP_EQ, &&L_OP_LT, &&L_OP_LE,
+    &&L_OP_TEST, &&L_OP_TESTSET, &&L_OP_CALL, &&L_OP_TAILCALL,
+    &&L_OP_RETURN, &&L_OP_FORLOOP, &&L_OP_FORPREP, &&L_OP_TFORCALL,
+    &&L_OP_TFORLOOP, &&L_OP_SETLIST, &&L_OP_CLOSURE, &&L_OP_VARARG,
+    &&L_OP_EXTRAARG
+  };
+#endif
  newframe:  /* reentry point when frame changes (call/return) */
   lua_assert(ci == L->ci);
   cl = clLvalue(ci->func);
@@ -543,16 +827,7 @@ void luaV_execute (lua_State *L) {
   base = ci->u.l.base;
   /* main loop of interpreter */
   for (;;) {
-    Instruction i = *(ci->u.l.savedpc++);
-    StkId ra;
-    if ((L->hookmask & (LUA_MASKLINE | LUA_MASKCOUNT)) &&
-        (--L->hookcount == 0 || L->hookmask & LUA_MASKLINE)) {
-      Protect(traceexec(L));
-    }
-    /* WARNING: several calls may realloc the stack and invalidate `ra' */
-    ra = RA(i);
-    lua_assert(base == ci->u.l.base);
-    lua_assert(base <= L->top && L->top < L->stack + L->stacksize);
+    vmfetch();
     vmdispatch (GET_OPCODE(i)) {
       vmcase(OP_MOVE,
         setobjs2s(L, ra, RB(i));
@@ -583,10 +858,10 @@ void luaV_execute (lua_State *L) {
       )
       vmcase(OP_GETTABUP,
         int b = GETARG_B(i);
-        Protect(luaV_gettable(L, cl->upvals[b]->v, RKC(i), ra));
+        gettable_cached(cl->upvals[b]->v, ra);
       )
       vmcase(OP_GETTABLE,
-        Protect(luaV_gettable(L, RB(i), RKC(i), ra));
+        gettable_cached(RB(i), ra);
       )
       vmcase(OP_SETTABUP,
         int a = GETARG_A(i);
@@ -612,29 +887,34 @@ void luaV_execute (lua_State *L) {
       vmcase(OP_SELF,
         StkId rb = RB(i);
         setobjs2s(L, ra+1, rb);
-        Protect(luaV_gettable(L, rb, RKC(i), ra));
+        gettable_cached(rb, ra);
       )
       vmcase(OP_ADD,
-        arith_op(luai_numadd, TM_ADD);
+        arith_iop(intadd, luai_numadd, TM_ADD);
       )
       vmcase(OP_SUB,
-        arith_op(luai_numsub, TM_SUB);
+        arith_iop(intsub, luai_numsub, TM_SUB);
       )
       vmcase(OP_MUL,
-        arith_op(luai_nummul, TM_MUL);
+        arith_iop(intmul, luai_nummul, TM_MUL);
       )
       vmcase(OP_DIV,
         arith_op(luai_numdiv, TM_DIV);
       )
       vmcase(OP_MOD,
-        arith_op(luai_nummod, TM_MOD);
+        arith_iop(intmod, luai_nummod, TM_MOD);
       )
       vmcase(OP_POW,
         arith_op(luai_numpow, TM_POW);
       )
       vmcase(OP_UNM,
         TValue *rb = RB(i);
-        if (ttisnumber(rb)) {
+        if (ttisinteger(rb) && ivalue(rb) != MIN_LUAINTEGER &&
+            ivalue(rb) != 0) {  /* -0 must be a float */
+          lua_Integer ib = ivalue(rb);
+          setivalue(ra, intop(-, 0, ib));
+        }
+        else if (ttisnumber(rb)) {
           lua_Number nb = nvalue(rb);
           setnvalue(ra, luai_numunm(L, nb));
         }
@@ -765,14 +1045,26 @@ void luaV_execute (lua_State *L) {
         }
       )
       vmcase(OP_FORLOOP,
-        lua_Number step = nvalue(ra+2);
-        lua_Number idx = luai_numadd(L, nvalue(ra), step); /* increment index */
-        lua_Number limit = nvalue(ra+1);
-        if (luai_numlt(L, 0, step) ? luai_numle(L, idx, limit)
-                                   : luai_numle(L, limit, idx)) {
-          ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
-          setnvalue(ra, idx);  /* update internal index... */
-          setnvalue(ra+3, idx);  /* ...and external index */
+        if (ttisinteger(ra)) {  /* integer loop? */
+          lu_integer count = cast(lu_integer, ivalue(ra+1));
+          if (count > 0) {  /* still more iterations? */
+            lua_Integer idx = intop(+, ivalue(ra), ivalue(ra+2));
+            ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
+            setivalue(ra+1, cast(lua_Integer, count - 1));
+            setivalue(ra, idx);  /* update internal index... */
+            setivalue(ra+3, idx);  /* ...and external index */
+          }
+        }
+        else {
+          lua_Number step = nvalue(ra+2);
+          lua_Number idx = luai_numadd(L, nvalue(ra), step); /* increment index */
+          lua_Number limit = nvalue(ra+1);
+          if (luai_numlt(L, 0, step) ? luai_numle(L, idx, limit)
+                                     : luai_numle(L, limit, idx)) {
+            ci->u.l.savedpc += GETARG_sBx(i);  /* jump back */
+            setnvalue(ra, idx);  /* update internal index... */
+            setnvalue(ra+3, idx);  /* ...and external index */
+          }
         }
       )
       vmcase(OP_FORPREP,
@@ -785,7 +1077,12 @@ void luaV_execute (lua_State *L) {
           luaG_runerror(L, LUA_QL("for") " limit must be a number");
         else if (!tonumber(pstep, ra+2))
           luaG_runerror(L, LUA_QL("for") " step must be a number");
-        setnvalue(ra, luai_numsub(L, nvalue(ra), nvalue(pstep)));
+        if (!forprepint(ra)) {  /* not an integer loop? */
+          lua_Number step = nvalue(pstep);
+          setnvalue(ra+1, nvalue(plimit));
+          setnvalue(ra+2, step);
+          setnvalue(ra, luai_numsub(L, nvalue(ra), step));
+        }
         ci->u.l.savedpc += GETARG_sBx(i);
       )
       vmcasenb(OP_TFORCALL,
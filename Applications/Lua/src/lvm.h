@@ -17,7 +17,10 @@
 
 #define tonumber(o,n)	(ttisnumber(o) || (((o) = luaV_tonumber(o,n)) != NULL))
 
-#define equalobj(L,o1,o2)  (ttisequal(o1, o2) && luaV_equalobj_(L, o1, o2))
+/* integers and floats are different tags but may be equal numbers */
+#define eqtype(o1,o2)	(ttisequal(o1, o2) || (ttisnumber(o1) && ttisnumber(o2)))
+
+#define equalobj(L,o1,o2)  (eqtype(o1, o2) && luaV_equalobj_(L, o1, o2))
 
 #define luaV_rawequalobj(o1,o2)		equalobj(NULL,o1,o2)
 
@@ -29,6 +32,7 @@ LUAI_FUNC int luaV_equalobj_ (lua_State *L, const TValue *t1, const TValue *t2);
 LUAI_FUNC int luaV_lessthan (lua_State *L, const TValue *l, const TValue *r);
 LUAI_FUNC int luaV_lessequal (lua_State *L, const TValue *l, const TValue *r);
 LUAI_FUNC const TValue *luaV_tonumber (const TValue *obj, TValue *n);
+LUAI_FUNC int luaV_numtointeger (lua_Number n, lua_Integer *p);
 LUAI_FUNC int luaV_tostring (lua_State *L, StkId obj);
 LUAI_FUNC void luaV_gettable (lua_State *L, const TValue *t, TValue *key,
                                             StkId val);
@@ -37,6 +41,8 @@ LUAI_FUNC void luaV_settable (lua_State *L, const TValue *t, TValue *key,
 LUAI_FUNC void luaV_finishOp (lua_State *L);
 LUAI_FUNC void luaV_execute (lua_State *L);
 LUAI_FUNC void luaV_concat (lua_State *L, int total);
+LUAI_FUNC int luaV_concattable (lua_State *L, Table *t, int i, int j,
+                                const char *sep, size_t lsep);
 LUAI_FUNC void luaV_arith (lua_State *L, StkId ra, const TValue *rb,
                            const TValue *rc, TMS op);
 LUAI_FUNC void luaV_objlen (lua_State *L, StkId ra, const TValue *rb);
@@ -0,0 +1,63 @@
+-- Reading lines from files opened in text mode, which read ahead
+-- where text streams are the same as binary ones.
+
+local name = os.tmpname()
+
+local lines = {}
+for i = 1, 5000 do
+  lines[i] = string.rep(string.char(97 + i % 26), i % 97) .. i
+end
+lines[#lines + 1] = string.rep("x", 100000)  -- longer than the buffer
+lines[#lines + 1] = ""
+lines[#lines + 1] = "last"
+
+local f = assert(io.open(name, "w"))
+f:write(table.concat(lines, "\n"), "\n")
+f:close()
+
+-- io.lines with a file name
+local i = 0
+for l in io.lines(name) do
+  i = i + 1
+  assert(l == lines[i])
+end
+assert(i == #lines)
+
+-- default mode, mixing lines, counts and numbers
+f = assert(io.open(name))
+assert(f:read("*l") == lines[1])
+assert(f:read("*L") == lines[2] .. "\n")
+assert(f:read(3) == string.sub(lines[3], 1, 3))
+assert(f:read("*l") == string.sub(lines[3], 4))
+assert(f:read("*n") == nil)  -- "dddd4" is not a numeral
+
+-- the position seen by seek is that of the data consumed
+f:seek("set")
+for j = 1, 10 do assert(f:read("*l") == lines[j]) end
+local pos = f:seek()
+local len = 0
+for j = 1, 10 do len = len + #lines[j] + 1 end
+assert(pos == len)
+f:seek("set", pos)
+assert(f:read("*l") == lines[11])
+
+-- writes go where reading stopped
+f:close()
+f = assert(io.open(name, "r+"))
+assert(f:read("*l") == lines[1])
+f:write("Z")
+f:seek("set")
+assert(f:read("*l") == lines[1])
+assert(f:read("*l") == "Z" .. string.sub(lines[2], 2))
+f:close()
+
+-- input file
+io.input(name)
+assert(io.read("*l") == lines[1])
+assert(io.read("*a") ~= "")
+assert(io.read("*l") == nil)
+io.input():close()
+io.input(io.stdin)
+
+os.remove(name)
+print("iolines OK")
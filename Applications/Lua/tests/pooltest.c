@@ -0,0 +1,114 @@
+/*
+** Tests for the pool allocator of lauxlib ('luaL_newstatepool').
+** 'malloc' and 'realloc' are wrapped so that they can be made to fail;
+** shrinking a block must still succeed, as Lua requires.
+**
+** It includes lauxlib.c, so it links with all the other Lua objects;
+** "make test" in src builds and runs it. It prints "pool tests OK".
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+static int failalloc = 0;  /* when set, 'malloc' and 'realloc' fail */
+
+static void *test_malloc (size_t size) {
+  return failalloc ? NULL : malloc(size);
+}
+
+static void *test_realloc (void *ptr, size_t size) {
+  return failalloc ? NULL : realloc(ptr, size);
+}
+
+#define malloc(s)	test_malloc(s)
+#define realloc(p,s)	test_realloc(p,s)
+
+#include "lauxlib.c"
+
+#include "lualib.h"
+
+
+#define check(c)  { if (!(c)) { \
+  fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #c); \
+  exit(EXIT_FAILURE); } }
+
+
+static void fill (unsigned char *b, size_t n, int seed) {
+  size_t i;
+  for (i = 0; i < n; i++) b[i] = (unsigned char)(seed + i);
+}
+
+static int same (const unsigned char *b, size_t n, int seed) {
+  size_t i;
+  for (i = 0; i < n; i++)
+    if (b[i] != (unsigned char)(seed + i)) return 0;
+  return 1;
+}
+
+
+/*
+** shrinks of every kind with the system allocator failing: within a
+** class, to a smaller class, large to large and large to small
+*/
+static void test_shrinks (void) {
+  static const size_t sizes[][2] = {
+    {24, 20}, {200, 16}, {256, 8}, {4000, 1000}, {300, 256}, {257, 249},
+    {5000, 100}, {1000, 1}
+  };
+  Pool *pool = (Pool *)calloc(1, sizeof(Pool));
+  size_t i;
+  check(pool != NULL);
+  pool->owned = 1;
+  for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    size_t osize = sizes[i][0], nsize = sizes[i][1];
+    unsigned char *b = (unsigned char *)pool_alloc(pool, NULL, 0, osize);
+    check(b != NULL);
+    fill(b, osize, (int)i);
+    failalloc = 1;
+    b = (unsigned char *)pool_alloc(pool, b, osize, nsize);
+    check(b != NULL);  /* shrinking never fails */
+    check(same(b, nsize, (int)i));
+    failalloc = 0;
+    /* the block keeps working: grow it back and free it */
+    b = (unsigned char *)pool_alloc(pool, b, nsize, osize);
+    check(b != NULL && same(b, nsize, (int)i));
+    check(pool_alloc(pool, b, osize, 0) == NULL);
+  }
+  check(pool->live == 0);
+  check(pool->st.usedbytes == 0 && pool->st.largebytes == 0);
+  pool_release(pool);
+}
+
+
+/*
+** a whole state: the collector shrinks the string table and other
+** structures while the system has no memory left
+*/
+static void test_state (void) {
+  lua_State *L = luaL_newstatepool();
+  luaL_PoolStats st;
+  check(L != NULL);
+  luaL_openlibs(L);
+  check(luaL_dostring(L,
+    "local t = {} for i = 1, 20000 do t[i] = 'string ' .. i end "
+    "local s = {} for i = 1, 200 do s[i] = string.rep('x', i * 3) end "
+    "collectgarbage('stop')") == 0);
+  failalloc = 1;
+  lua_gc(L, LUA_GCRESTART, 0);
+  lua_gc(L, LUA_GCCOLLECT, 0);  /* must not raise a memory error */
+  lua_gc(L, LUA_GCCOLLECT, 0);
+  failalloc = 0;
+  check(luaL_dostring(L, "assert(#('a' .. 'b') == 2)") == 0);
+  check(luaL_poolstats(L, &st) && st.nallocs > st.nfrees);
+  lua_close(L);
+}
+
+
+int main (void) {
+  test_shrinks();
+  test_state();
+  printf("pool tests OK\n");
+  return 0;
+}